@@ -0,0 +1,473 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "analysis/analysis.h"
+#include "sigproc.h"
+
+#include "debug.h"
+#include "util.h"
+
+
+void spectrum_alloc(struct spectrum *s, int number_of_bins) {
+    s->t = 0;
+    s->number_of_peaks_l = s->number_of_peaks_r = 0;
+    s->f_lo = LOWER_CUTOFF_FREQ;
+    s->f_hi = UPPER_CUTOFF_FREQ;
+    s->bins_l = calloc(number_of_bins, sizeof(sample_t));
+    s->bins_r = calloc(number_of_bins, sizeof(sample_t));
+    s->floor_l = calloc(number_of_bins, sizeof(sample_t));
+    s->floor_r = calloc(number_of_bins, sizeof(sample_t));
+}
+
+void spectrum_free(struct spectrum *s) {
+    free(s->bins_l);
+    free(s->bins_r);
+    free(s->floor_l);
+    free(s->floor_r);
+}
+
+void analysis_init(struct analysis *a, struct audio_data *audio, struct config_params *p, int number_of_bins) {
+    memset(a, 0, sizeof(*a));
+    a->audio = audio;
+    a->size = p->fft_size;
+    a->number_of_bins = number_of_bins;
+    if (!strcmp(p->transform, "sdft")) {
+        a->transform = TRANSFORM_SDFT;
+    } else if (!strcmp(p->transform, "multirate")) {
+        a->transform = TRANSFORM_MULTIRATE;
+        // fft_size sets the bass resolution; the hop follows the short band transforms
+        multirate_init(&a->multirate, p->fft_size);
+        a->size = a->multirate.size;
+    } else if (!strcmp(p->transform, "cqt")) {
+        a->transform = TRANSFORM_CQT;
+        // one bar per constant-Q bin
+        cqt_init(&a->cqt, a->size, p->bins_per_octave);
+        a->number_of_bins = a->cqt.bins;
+    } else if (!strcmp(p->transform, "reassigned")) {
+        a->transform = TRANSFORM_REASSIGNED;
+    } else if (!strcmp(p->transform, "zoom")) {
+        a->transform = TRANSFORM_ZOOM;
+        zoom_init(&a->zoom, p->fft_size, a->number_of_bins);
+        a->size = a->zoom.size;
+        a->zoom_lo = p->zoom_low;
+        a->zoom_hi = p->zoom_high;
+    } else {
+        a->transform = TRANSFORM_FFT;
+    }
+    a->overlap = p->overlap;
+    a->hop = max(1, (int)(a->size * (1.0 - p->overlap)));
+    debug("analysis: %s, %d point transform every %d samples\n", p->transform, a->size, a->hop);
+
+    // history starts silent and fills as audio arrives
+    a->hist_l = FFTW(alloc_real)(a->size);
+    a->hist_r = FFTW(alloc_real)(a->size);
+    memset(a->hist_l, 0, a->size * sizeof(sample_t));
+    memset(a->hist_r, 0, a->size * sizeof(sample_t));
+
+    // allocate fft memory
+    a->windowed_l = FFTW(alloc_real)(a->size);
+    a->windowed_r = FFTW(alloc_real)(a->size);
+    a->out_l = FFTW(alloc_complex)(a->size / 2 + 1);
+    a->out_r = FFTW(alloc_complex)(a->size / 2 + 1);
+    memset(a->out_l, 0, (a->size / 2 + 1) * sizeof(fft_complex));
+    memset(a->out_r, 0, (a->size / 2 + 1) * sizeof(fft_complex));
+
+    a->levels = malloc((a->size / 2 + 1) * sizeof(sample_t));
+    a->p_l = fft_plan_r2c(a->size, a->windowed_l, a->out_l);
+    a->p_r = fft_plan_r2c(a->size, a->windowed_r, a->out_r);
+
+    if (a->transform == TRANSFORM_REASSIGNED) {
+        // transformed by the same plans, which FFTW allows for arrays of the same alignment
+        a->windowed_d_l = FFTW(alloc_real)(a->size);
+        a->windowed_d_r = FFTW(alloc_real)(a->size);
+        a->out_d_l = FFTW(alloc_complex)(a->size / 2 + 1);
+        a->out_d_r = FFTW(alloc_complex)(a->size / 2 + 1);
+    }
+    if (a->transform == TRANSFORM_SDFT) {
+        sdft_init(&a->sdft, a->size);
+        a->delta_l = FFTW(alloc_real)(a->size);
+        a->delta_r = FFTW(alloc_real)(a->size);
+    }
+
+    enum averaging averaging = AVERAGE_NONE;
+    average_mode(p->averaging, &averaging);
+    average_init(&a->average, averaging, a->number_of_bins, p->average_frames, p->hold_decay);
+    floor_init(&a->floor, a->number_of_bins);
+
+    enum weighting_curve curve = WEIGHTING_Z;
+    weighting_curve(p->weighting, &curve);
+    weighting_init(&a->weighting, curve, p->userEQ, p->userEQ_keys);
+
+    spectrum_alloc(&a->frame, a->number_of_bins);
+    for (int n = 0; n < SPECTRUM_QUEUE_LENGTH; n++) {
+        spectrum_alloc(&a->queue[n], a->number_of_bins);
+    }
+    pthread_mutex_init(&a->lock, NULL);
+}
+
+// copy capture samples up to the capture sample count `until` into the history
+static void analysis_consume(struct analysis *a, unsigned long long until) {
+    struct audio_data *audio = a->audio;
+    bool slide = a->transform == TRANSFORM_SDFT && audio->rate;
+    int ring = audio->FFTbufferSize;
+    int i = (int)(a->consumed % ring);
+    int j = a->hist_index;
+    int m = 0;
+    if (slide) {
+        sdft_range(&a->sdft, audio->rate);
+    }
+    if (a->transform == TRANSFORM_MULTIRATE || a->transform == TRANSFORM_ZOOM) {
+        // at most two runs, either side of the end of the ring
+        int samples = (int)(until - a->consumed);
+        int first = min(samples, ring - i);
+        if (a->transform == TRANSFORM_MULTIRATE) {
+            multirate_push(&a->multirate, audio->in_l + i, audio->in_r + i, first);
+            multirate_push(&a->multirate, audio->in_l, audio->in_r, samples - first);
+        } else {
+            pthread_mutex_lock(&a->lock);
+            double lo = a->zoom_lo, hi = a->zoom_hi;
+            pthread_mutex_unlock(&a->lock);
+            zoom_band(&a->zoom, lo, hi, audio->rate, &a->weighting);
+            zoom_push(&a->zoom, audio->in_l + i, audio->in_r + i, first);
+            zoom_push(&a->zoom, audio->in_l, audio->in_r, samples - first);
+        }
+    }
+    for (; a->consumed < until; a->consumed++) {
+        if (slide) {
+            // the sample leaving the history is the one being overwritten
+            a->delta_l[m] = audio->in_l[i] - a->hist_l[j];
+            a->delta_r[m] = audio->in_r[i] - a->hist_r[j];
+            if (++m == a->size) {
+                sdft_slide(&a->sdft, a->delta_l, a->delta_r, m);
+                m = 0;
+            }
+        }
+        a->hist_l[j] = audio->in_l[i];
+        a->hist_r[j] = audio->in_r[i];
+        if (++i == ring)
+            i = 0;
+        if (++j == a->size)
+            j = 0;
+    }
+    if (slide && m) {
+        sdft_slide(&a->sdft, a->delta_l, a->delta_r, m);
+    }
+    a->hist_index = j;
+}
+
+// the peaks of a channel of the frame just transformed, against its floor
+static int analysis_peaks(struct analysis *a, bool right, struct peak *peaks) {
+    unsigned int rate = a->audio->rate;
+    const sample_t *floor = right ? a->floor.floor_r : a->floor.floor_l;
+    if (a->transform == TRANSFORM_CQT || a->transform == TRANSFORM_ZOOM) {
+        return peaks_find_bins(right ? a->frame.bins_r : a->frame.bins_l, floor, a->number_of_bins,
+                a->frame.f_lo, a->frame.f_hi, peaks, PEAKS_MAX);
+    }
+    if (a->transform == TRANSFORM_MULTIRATE) {
+        // each band's transform bins on its own rate
+        const struct multirate *m = &a->multirate;
+        int found = 0;
+        for (int s = 0; s < m->bands; s++) {
+            const struct multirate_band *b = &m->band[s];
+            const sample_t *power = right ? b->power_r : b->power_l;
+            for (int k = b->kmin; k < b->kmax; k++) {
+                a->levels[k] = b->bin[k] < 0 ? 0 : power[k] * b->weight[k];
+            }
+            power_dB(a->levels + b->kmin, a->levels + b->kmin, b->kmax - b->kmin);
+            found = peaks_find(a->levels, b->bin, b->kmin, b->kmax, (double)rate / (b->decimation * m->size),
+                    floor, peaks, found, PEAKS_MAX);
+        }
+        return found;
+    }
+    int imin, imax;
+    bin_range(a->size, rate, &imin, &imax);
+    bin_levels(right ? a->out_r : a->out_l, a->size, rate, &a->weighting, a->levels);
+    return peaks_find(a->levels, bin_bars(a->size, rate, a->number_of_bins), imin, imax, (double)rate / a->size,
+            floor, peaks, 0, PEAKS_MAX);
+}
+
+// average a finished frame, track its floor and hand both to the renderer in dB,
+// dropping the oldest if it has not kept up
+static void analysis_push(struct analysis *a) {
+    int n = a->number_of_bins;
+    average_frame(&a->average, a->frame.bins_l, a->frame.bins_r,
+            a->frame.t, a->audio->rate, a->frame.f_lo, a->frame.f_hi);
+    // the one conversion to dB of the frame, which everything downstream uses directly
+    power_dB(a->frame.bins_l, a->frame.bins_l, n);
+    power_dB(a->frame.bins_r, a->frame.bins_r, n);
+    floor_frame(&a->floor, a->frame.bins_l, a->frame.bins_r,
+            a->frame.t, a->audio->rate, a->frame.f_lo, a->frame.f_hi);
+    a->frame.number_of_peaks_l = analysis_peaks(a, false, a->frame.peaks_l);
+    a->frame.number_of_peaks_r = analysis_peaks(a, true, a->frame.peaks_r);
+    pthread_mutex_lock(&a->lock);
+    struct spectrum *s = &a->queue[a->head];
+    s->t = a->frame.t;
+    s->f_lo = a->frame.f_lo;
+    s->f_hi = a->frame.f_hi;
+    memcpy(s->bins_l, a->frame.bins_l, n * sizeof(sample_t));
+    memcpy(s->bins_r, a->frame.bins_r, n * sizeof(sample_t));
+    memcpy(s->floor_l, a->floor.floor_l, n * sizeof(sample_t));
+    memcpy(s->floor_r, a->floor.floor_r, n * sizeof(sample_t));
+    memcpy(s->peaks_l, a->frame.peaks_l, sizeof(s->peaks_l));
+    memcpy(s->peaks_r, a->frame.peaks_r, sizeof(s->peaks_r));
+    s->number_of_peaks_l = a->frame.number_of_peaks_l;
+    s->number_of_peaks_r = a->frame.number_of_peaks_r;
+    a->head = (a->head + 1) % SPECTRUM_QUEUE_LENGTH;
+    a->count = min(a->count + 1, SPECTRUM_QUEUE_LENGTH);
+    pthread_mutex_unlock(&a->lock);
+}
+
+// the band binned by make_bins() for a transform of this length, from whole transform bins
+static void analysis_band(struct analysis *a, int size, unsigned int rate) {
+    int imin, imax;
+    bin_range(size, rate, &imin, &imax);
+    a->frame.f_lo = (double)imin * rate / size;
+    a->frame.f_hi = (double)imax * rate / size;
+}
+
+// window, transform and bin the history
+static void analysis_frame(struct analysis *a) {
+    unsigned int rate = a->audio->rate;
+    if (rate == 0) {
+        return;
+    }
+    // take up a reloaded weighting; the bin tables follow it from its generation
+    pthread_mutex_lock(&a->lock);
+    if (a->weighting_changed) {
+        weighting_free(&a->weighting);
+        a->weighting = a->weighting_next;
+        memset(&a->weighting_next, 0, sizeof(a->weighting_next));
+        a->weighting_changed = false;
+    }
+    pthread_mutex_unlock(&a->lock);
+    if (a->transform == TRANSFORM_MULTIRATE) {
+        // the bands are binned as they are stitched together
+        multirate_frame(&a->multirate, rate, &a->weighting, a->frame.bins_l, a->frame.bins_r, a->number_of_bins);
+        analysis_band(a, a->multirate.equivalent, rate);
+        a->frame.t = a->consumed;
+        analysis_push(a);
+        return;
+    }
+    if (a->transform == TRANSFORM_ZOOM) {
+        if (a->zoom.rate == 0) {
+            return;
+        }
+        zoom_frame(&a->zoom, a->frame.bins_l, a->frame.bins_r);
+        a->frame.f_lo = a->zoom.lo;
+        a->frame.f_hi = a->zoom.hi;
+        a->frame.t = a->consumed;
+        analysis_push(a);
+        return;
+    }
+    if (a->transform == TRANSFORM_CQT) {
+        // the kernel carries the window
+        cqt_range(&a->cqt, rate, &a->weighting);
+        window(a->hist_l, a->hist_index, a->windowed_l, a->size, RECT);
+        window(a->hist_r, a->hist_index, a->windowed_r, a->size, RECT);
+        FFTW(execute)(a->p_l);
+        FFTW(execute)(a->p_r);
+        cqt_bins(&a->cqt, a->out_l, a->frame.bins_l);
+        cqt_bins(&a->cqt, a->out_r, a->frame.bins_r);
+        a->frame.t = a->consumed;
+        analysis_push(a);
+        return;
+    }
+    if (a->transform == TRANSFORM_REASSIGNED) {
+        window(a->hist_l, a->hist_index, a->windowed_l, a->size, HANN);
+        window(a->hist_r, a->hist_index, a->windowed_r, a->size, HANN);
+        window(a->hist_l, a->hist_index, a->windowed_d_l, a->size, DHAN);
+        window(a->hist_r, a->hist_index, a->windowed_d_r, a->size, DHAN);
+        FFTW(execute)(a->p_l);
+        FFTW(execute)(a->p_r);
+        FFTW(execute_dft_r2c)(a->p_l, a->windowed_d_l, a->out_d_l);
+        FFTW(execute_dft_r2c)(a->p_r, a->windowed_d_r, a->out_d_r);
+        make_bins_reassigned(a->out_l, a->out_d_l, a->size, rate, &a->weighting, a->frame.bins_l, a->number_of_bins);
+        make_bins_reassigned(a->out_r, a->out_d_r, a->size, rate, &a->weighting, a->frame.bins_r, a->number_of_bins);
+        analysis_band(a, a->size, rate);
+        a->frame.t = a->consumed;
+        analysis_push(a);
+        return;
+    }
+    if (a->transform == TRANSFORM_SDFT) {
+        if (sdft_range(&a->sdft, rate) || sdft_due(&a->sdft)) {
+            // full transform of the unwindowed history
+            window(a->hist_l, a->hist_index, a->windowed_l, a->size, RECT);
+            window(a->hist_r, a->hist_index, a->windowed_r, a->size, RECT);
+            FFTW(execute)(a->p_l);
+            FFTW(execute)(a->p_r);
+            sdft_resync(&a->sdft, a->out_l, a->out_r);
+        }
+        sdft_hann(&a->sdft, a->out_l, a->out_r);
+    } else {
+        window(a->hist_l, a->hist_index, a->windowed_l, a->size, HANN);
+        window(a->hist_r, a->hist_index, a->windowed_r, a->size, HANN);
+        FFTW(execute)(a->p_l);
+        FFTW(execute)(a->p_r);
+    }
+    make_bins(a->out_l, a->size, rate, &a->weighting, a->frame.bins_l, a->number_of_bins);
+    make_bins(a->out_r, a->size, rate, &a->weighting, a->frame.bins_r, a->number_of_bins);
+    analysis_band(a, a->size, rate);
+    a->frame.t = a->consumed;
+    analysis_push(a);
+}
+
+// sleep for about the audio time of the given number of samples
+static void analysis_sleep(struct analysis *a, unsigned long long samples) {
+    long nsec = 1e7;
+    if (a->audio->rate) {
+        nsec = (long)fmin(2e7, fmax(5e5, 1e9 * samples / a->audio->rate));
+    }
+    struct timespec req = {.tv_sec = 0, .tv_nsec = nsec};
+    nanosleep(&req, NULL);
+}
+
+// capture samples until the next frame; large transforms are held to LARGE_FFT_RATE per second
+static int analysis_hop(struct analysis *a) {
+    unsigned int rate = a->audio->rate;
+    if (a->transform == TRANSFORM_ZOOM) {
+        return zoom_hop(&a->zoom, a->overlap);
+    }
+    if (a->size >= LARGE_FFT_SIZE && rate) {
+        return max(a->hop, (int)(rate / LARGE_FFT_RATE));
+    }
+    return a->hop;
+}
+
+static void *analysis_thread(void *data) {
+    struct analysis *a = (struct analysis *)data;
+    // keep clear of the part of the ring the input thread may be writing
+    const unsigned long long capacity = a->audio->FFTbufferSize - a->audio->FFTbufferSize / 4;
+
+    while (!a->terminate) {
+        unsigned long long captured = audio_samples(a->audio);
+        if (captured - a->consumed > capacity) {
+            debug("analysis fell behind, dropping %llu samples\n", captured - capacity - a->consumed);
+            a->consumed = captured - capacity;
+            a->next = max(a->next, a->consumed);
+        }
+        analysis_consume(a, min(captured, a->next));
+        if (a->consumed == a->next) {
+            analysis_frame(a);
+            a->next += analysis_hop(a);
+        } else {
+            analysis_sleep(a, a->next - captured);
+        }
+    }
+    return NULL;
+}
+
+void analysis_start(struct analysis *a) {
+    // frames are scheduled from the current capture position
+    a->consumed = audio_samples(a->audio);
+    a->next = a->consumed + analysis_hop(a);
+    a->terminate = 0;
+    pthread_create(&a->thread, NULL, analysis_thread, (void *)a);
+    a->started = true;
+}
+
+// copy the newest finished frame into s, discarding older ones; false if there is none
+bool analysis_latest(struct analysis *a, struct spectrum *s) {
+    bool fresh = false;
+    pthread_mutex_lock(&a->lock);
+    if (a->count) {
+        struct spectrum *newest = &a->queue[(a->head + SPECTRUM_QUEUE_LENGTH - 1) % SPECTRUM_QUEUE_LENGTH];
+        s->t = newest->t;
+        s->f_lo = newest->f_lo;
+        s->f_hi = newest->f_hi;
+        memcpy(s->bins_l, newest->bins_l, a->number_of_bins * sizeof(sample_t));
+        memcpy(s->bins_r, newest->bins_r, a->number_of_bins * sizeof(sample_t));
+        memcpy(s->floor_l, newest->floor_l, a->number_of_bins * sizeof(sample_t));
+        memcpy(s->floor_r, newest->floor_r, a->number_of_bins * sizeof(sample_t));
+        memcpy(s->peaks_l, newest->peaks_l, sizeof(s->peaks_l));
+        memcpy(s->peaks_r, newest->peaks_r, sizeof(s->peaks_r));
+        s->number_of_peaks_l = newest->number_of_peaks_l;
+        s->number_of_peaks_r = newest->number_of_peaks_r;
+        a->count = 0;
+        fresh = true;
+    }
+    pthread_mutex_unlock(&a->lock);
+    return fresh;
+}
+
+// move the zoomed band by shift of its width and scale its width about the centre
+void analysis_zoom(struct analysis *a, double shift, double scale) {
+    if (a->transform != TRANSFORM_ZOOM) {
+        return;
+    }
+    double nyquist = a->audio->rate ? a->audio->rate / 2.0 : UPPER_CUTOFF_FREQ;
+    pthread_mutex_lock(&a->lock);
+    double width = a->zoom_hi - a->zoom_lo;
+    double centre = (a->zoom_lo + a->zoom_hi) / 2 + shift * width;
+    width = fmin(nyquist / 2, fmax(ZOOM_MIN_WIDTH, width * scale));
+    // keep the band above DC, for the log axis, and below Nyquist
+    centre = fmax(centre, width / 2 + ZOOM_MIN_WIDTH);
+    centre = fmin(centre, nyquist - width / 2);
+    a->zoom_lo = centre - width / 2;
+    a->zoom_hi = centre + width / 2;
+    debug("zoom: %.2f to %.2fHz requested\n", a->zoom_lo, a->zoom_hi);
+    pthread_mutex_unlock(&a->lock);
+}
+
+// take the weighting and user EQ from a reloaded config
+void analysis_weighting(struct analysis *a, struct config_params *p) {
+    enum weighting_curve curve = WEIGHTING_Z;
+    weighting_curve(p->weighting, &curve);
+    pthread_mutex_lock(&a->lock);
+    weighting_free(&a->weighting_next);
+    weighting_init(&a->weighting_next, curve, p->userEQ, p->userEQ_keys);
+    a->weighting_changed = true;
+    pthread_mutex_unlock(&a->lock);
+}
+
+void analysis_cleanup(struct analysis *a) {
+    if (a->started) {
+        a->terminate = 1;
+        pthread_join(a->thread, NULL);
+        a->started = false;
+    }
+    pthread_mutex_destroy(&a->lock);
+
+    if (a->transform == TRANSFORM_SDFT) {
+        sdft_free(&a->sdft);
+        FFTW(free)(a->delta_l);
+        FFTW(free)(a->delta_r);
+    }
+    if (a->transform == TRANSFORM_MULTIRATE) {
+        multirate_free(&a->multirate);
+    }
+    if (a->transform == TRANSFORM_CQT) {
+        cqt_free(&a->cqt);
+    }
+    if (a->transform == TRANSFORM_ZOOM) {
+        zoom_free(&a->zoom);
+    }
+    if (a->transform == TRANSFORM_REASSIGNED) {
+        FFTW(free)(a->windowed_d_l);
+        FFTW(free)(a->windowed_d_r);
+        FFTW(free)(a->out_d_l);
+        FFTW(free)(a->out_d_r);
+    }
+
+    average_free(&a->average);
+    floor_free(&a->floor);
+    weighting_free(&a->weighting);
+    weighting_free(&a->weighting_next);
+    spectrum_free(&a->frame);
+    for (int n = 0; n < SPECTRUM_QUEUE_LENGTH; n++) {
+        spectrum_free(&a->queue[n]);
+    }
+
+    // free fft working space
+    FFTW(free)(a->hist_l);
+    FFTW(free)(a->hist_r);
+    FFTW(free)(a->windowed_l);
+    FFTW(free)(a->windowed_r);
+    FFTW(free)(a->out_l);
+    FFTW(free)(a->out_r);
+    free(a->levels);
+    FFTW(destroy_plan)(a->p_l);
+    FFTW(destroy_plan)(a->p_r);
+    FFTW(cleanup)();
+}
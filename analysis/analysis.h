@@ -0,0 +1,105 @@
+// Hop-scheduled spectral analysis, running on its own thread.
+// Transforms are due every hop capture samples, so the analysis cost follows
+// audio time rather than the display refresh rate.
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+
+#include "config.h"
+#include "input/common.h"
+#include "analysis/average.h"
+#include "analysis/cqt.h"
+#include "analysis/floor.h"
+#include "analysis/multirate.h"
+#include "analysis/peaks.h"
+#include "analysis/sdft.h"
+#include "analysis/weighting.h"
+#include "analysis/zoom.h"
+
+// finished frames waiting for the renderer
+#define SPECTRUM_QUEUE_LENGTH 4
+
+// spectrum source, [analysis] transform in the config
+enum transform {
+    TRANSFORM_FFT,      // windowed FFT of the history every hop
+    TRANSFORM_SDFT,     // sliding DFT updated per sample, resynced by FFT
+    TRANSFORM_MULTIRATE,    // short FFT per octave band of a decimator chain
+    TRANSFORM_CQT,      // constant-Q bins from one FFT by sparse kernel
+    TRANSFORM_ZOOM,     // complex FFT of one band, mixed down and decimated
+    TRANSFORM_REASSIGNED,   // windowed FFT with power moved to reassigned frequencies
+};
+
+// one finished analysis frame, binned for display
+struct spectrum {
+    unsigned long long t;       // capture sample count at the end of the frame
+    sample_t *bins_l, *bins_r;  // level of each display bin, in dB
+    sample_t *floor_l, *floor_r;    // noise floor under each display bin, in dB
+    struct peak peaks_l[PEAKS_MAX], peaks_r[PEAKS_MAX];    // loudest first
+    int number_of_peaks_l, number_of_peaks_r;
+    double f_lo, f_hi;          // frequencies the bins span, log-spaced
+};
+
+struct analysis {
+    struct audio_data *audio;
+    enum transform transform;
+    int size;                   // transform length
+    int hop;                    // capture samples between transforms, from the overlap
+    double overlap;
+    int number_of_bins;         // bars per frame, which the frames and their consumers are sized by
+    // time-ordered history ring, oldest sample at hist_index
+    sample_t *hist_l, *hist_r;
+    int hist_index;
+    unsigned long long consumed;    // capture samples copied into the history
+    unsigned long long next;        // capture sample count at which the next frame is due
+    // transform working space
+    sample_t *windowed_l, *windowed_r;
+    fft_complex *out_l, *out_r;
+    fft_plan p_l, p_r;
+    sample_t *levels;           // a channel's transform bins in dB, for the peaks
+    // derivative windowed history and its transform, for reassignment
+    sample_t *windowed_d_l, *windowed_d_r;
+    fft_complex *out_d_l, *out_d_r;
+    // sliding DFT state, and the x_new - x_old it slides by
+    struct sdft sdft;
+    sample_t *delta_l, *delta_r;
+    // octave band decimators and their transforms
+    struct multirate multirate;
+    // constant-Q kernel, which sets its own number of bins
+    struct cqt cqt;
+    // zoomed band, and the band asked for, which may change under the lock
+    struct zoom zoom;
+    double zoom_lo, zoom_hi;
+    // frequency weighting of the bins, and a new one from the config, handed over under the lock
+    struct weighting weighting, weighting_next;
+    bool weighting_changed;
+    struct spectrum frame;          // frame being computed
+    struct average average;         // smoothing of frames before they are queued
+    struct noise_floor floor;       // tracked under the averaged frames
+    // finished frames, oldest at queue[(head - count) % length]
+    struct spectrum queue[SPECTRUM_QUEUE_LENGTH];
+    int head, count;
+    pthread_mutex_t lock;
+    pthread_t thread;
+    bool started;
+    int terminate;
+};
+
+void spectrum_alloc(struct spectrum *s, int number_of_bins);
+
+void spectrum_free(struct spectrum *s);
+
+// number_of_bins is the bars wanted; the transform may make another number (one per
+// constant-Q bin), which a->number_of_bins then holds
+void analysis_init(struct analysis *a, struct audio_data *audio, struct config_params *p, int number_of_bins);
+
+void analysis_start(struct analysis *a);
+
+bool analysis_latest(struct analysis *a, struct spectrum *s);
+
+void analysis_zoom(struct analysis *a, double shift, double scale);
+
+void analysis_weighting(struct analysis *a, struct config_params *p);
+
+void analysis_cleanup(struct analysis *a);
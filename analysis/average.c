@@ -0,0 +1,185 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis/average.h"
+
+#include "debug.h"
+#include "util.h"
+
+
+// averaging mode by config name; false if the name is unknown
+bool average_mode(const char *name, enum averaging *mode) {
+    const struct {
+        const char *name;
+        enum averaging mode;
+    } modes[] = {
+        {"none", AVERAGE_NONE},
+        {"fast", AVERAGE_FAST_EXP},
+        {"slow", AVERAGE_SLOW_EXP},
+        {"impulse", AVERAGE_IMPULSE},
+        {"linear", AVERAGE_LINEAR},
+        {"max", AVERAGE_MAX_HOLD},
+        {"min", AVERAGE_MIN_HOLD},
+    };
+    for (size_t n = 0; n < ARRAY_SIZE(modes); n++) {
+        if (!strcmp(name, modes[n].name)) {
+            *mode = modes[n].mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+void average_init(struct average *v, enum averaging mode, int number_of_bins, int frames, double hold_decay) {
+    memset(v, 0, sizeof(*v));
+    v->mode = mode;
+    v->number_of_bins = number_of_bins;
+    v->frames = max(1, frames);
+    v->hold_decay = hold_decay;
+    v->avg_l = calloc(number_of_bins, sizeof(sample_t));
+    v->avg_r = calloc(number_of_bins, sizeof(sample_t));
+    if (mode == AVERAGE_LINEAR) {
+        v->ring_l = calloc((size_t)v->frames * number_of_bins, sizeof(sample_t));
+        v->ring_r = calloc((size_t)v->frames * number_of_bins, sizeof(sample_t));
+        v->sum_l = calloc(number_of_bins, sizeof(double));
+        v->sum_r = calloc(number_of_bins, sizeof(double));
+    }
+}
+
+// avg <- alpha avg + (1 - alpha) x
+static void average_exponential(sample_t *restrict avg, sample_t *restrict x, int n, sample_t alpha) {
+    for (int i = 0; i < n; i++) {
+        avg[i] = alpha * avg[i] + (1 - alpha) * x[i];
+        x[i] = avg[i];
+    }
+}
+
+// exponential, with the faster time constant while the power is rising
+static void average_impulse(sample_t *restrict avg, sample_t *restrict x, int n, sample_t rise, sample_t fall) {
+    for (int i = 0; i < n; i++) {
+        sample_t alpha = x[i] > avg[i] ? rise : fall;
+        avg[i] = alpha * avg[i] + (1 - alpha) * x[i];
+        x[i] = avg[i];
+    }
+}
+
+// replace the oldest frame in the ring with x, and x with the mean of the ring
+static void average_linear(struct average *v, sample_t *restrict ring, double *restrict sum, sample_t *restrict x) {
+    int n = v->number_of_bins;
+    sample_t *restrict oldest = ring + (size_t)v->head * n;
+    for (int i = 0; i < n; i++) {
+        sum[i] += x[i] - oldest[i];
+        oldest[i] = x[i];
+    }
+    if (v->head == 0) {
+        // re-sum once per pass round the ring, so rounding can't accumulate
+        memset(sum, 0, n * sizeof(double));
+        for (int f = 0; f < v->filled; f++) {
+            for (int i = 0; i < n; i++) {
+                sum[i] += ring[(size_t)f * n + i];
+            }
+        }
+    }
+    const double scale = 1.0 / v->filled;
+    for (int i = 0; i < n; i++) {
+        x[i] = sum[i] * scale;
+    }
+}
+
+// hold the larger of x and the decaying hold
+static void average_max(sample_t *restrict avg, sample_t *restrict x, int n, sample_t decay) {
+    for (int i = 0; i < n; i++) {
+        sample_t held = avg[i] * decay;
+        avg[i] = x[i] > held ? x[i] : held;
+        x[i] = avg[i];
+    }
+}
+
+// hold the smaller of x and the rising hold
+static void average_min(sample_t *restrict avg, sample_t *restrict x, int n, sample_t rise) {
+    for (int i = 0; i < n; i++) {
+        sample_t held = avg[i] * rise;
+        avg[i] = x[i] < held ? x[i] : held;
+        x[i] = avg[i];
+    }
+}
+
+// average the frame at capture time t into the running result, and replace the frame with it
+void average_frame(struct average *v, sample_t *bins_l, sample_t *bins_r,
+        unsigned long long t, unsigned int rate, double f_lo, double f_hi) {
+    int n = v->number_of_bins;
+    if (v->mode == AVERAGE_NONE || rate == 0) {
+        return;
+    }
+    if (!v->primed || f_lo != v->f_lo || f_hi != v->f_hi) {
+        // start from this frame
+        memcpy(v->avg_l, bins_l, n * sizeof(sample_t));
+        memcpy(v->avg_r, bins_r, n * sizeof(sample_t));
+        v->head = 0;
+        v->filled = 0;
+        if (v->mode == AVERAGE_LINEAR) {
+            memset(v->ring_l, 0, (size_t)v->frames * n * sizeof(sample_t));
+            memset(v->ring_r, 0, (size_t)v->frames * n * sizeof(sample_t));
+            memset(v->sum_l, 0, n * sizeof(double));
+            memset(v->sum_r, 0, n * sizeof(double));
+        }
+        v->f_lo = f_lo;
+        v->f_hi = f_hi;
+        v->primed = true;
+        if (v->mode != AVERAGE_LINEAR) {
+            v->t = t;
+            return;
+        }
+    }
+    // frames may come at varying intervals, so the weights follow audio time
+    double dt = (double)(t - v->t) / rate;
+    v->t = t;
+
+    switch (v->mode) {
+        case AVERAGE_FAST_EXP:
+        case AVERAGE_SLOW_EXP: {
+            sample_t alpha = exp(-dt / (v->mode == AVERAGE_FAST_EXP ? AVERAGE_FAST : AVERAGE_SLOW));
+            average_exponential(v->avg_l, bins_l, n, alpha);
+            average_exponential(v->avg_r, bins_r, n, alpha);
+            break;
+        }
+        case AVERAGE_IMPULSE: {
+            sample_t rise = exp(-dt / AVERAGE_IMPULSE_RISE);
+            sample_t fall = exp(-dt / AVERAGE_IMPULSE_FALL);
+            average_impulse(v->avg_l, bins_l, n, rise, fall);
+            average_impulse(v->avg_r, bins_r, n, rise, fall);
+            break;
+        }
+        case AVERAGE_LINEAR:
+            v->filled = min(v->filled + 1, v->frames);
+            average_linear(v, v->ring_l, v->sum_l, bins_l);
+            average_linear(v, v->ring_r, v->sum_r, bins_r);
+            v->head = (v->head + 1) % v->frames;
+            break;
+        case AVERAGE_MAX_HOLD:
+        case AVERAGE_MIN_HOLD: {
+            // hold_decay dB/s, as a power ratio over dt
+            sample_t decay = pow(10, -v->hold_decay * dt / 10);
+            if (v->mode == AVERAGE_MAX_HOLD) {
+                average_max(v->avg_l, bins_l, n, decay);
+                average_max(v->avg_r, bins_r, n, decay);
+            } else {
+                average_min(v->avg_l, bins_l, n, 1 / decay);
+                average_min(v->avg_r, bins_r, n, 1 / decay);
+            }
+            break;
+        }
+        case AVERAGE_NONE:
+            break;
+    }
+}
+
+void average_free(struct average *v) {
+    free(v->avg_l);
+    free(v->avg_r);
+    free(v->ring_l);
+    free(v->ring_r);
+    free(v->sum_l);
+    free(v->sum_r);
+}
@@ -0,0 +1,50 @@
+// Averaging of successive spectra, in power, before they are drawn.
+// Exponential averages follow the IEC 61672 sound level meter time weightings.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "util.h"
+
+// time constants in seconds
+#define AVERAGE_FAST 0.125
+#define AVERAGE_SLOW 1.0
+#define AVERAGE_IMPULSE_RISE 0.035
+#define AVERAGE_IMPULSE_FALL 1.5
+
+// [analysis] averaging in the config
+enum averaging {
+    AVERAGE_NONE,       // each frame as analysed
+    AVERAGE_FAST_EXP,   // exponential, 125ms
+    AVERAGE_SLOW_EXP,   // exponential, 1s
+    AVERAGE_IMPULSE,    // exponential, 35ms rising and 1.5s falling
+    AVERAGE_LINEAR,     // mean of the last average_frames frames (Welch)
+    AVERAGE_MAX_HOLD,   // running maximum, decaying at hold_decay dB/s
+    AVERAGE_MIN_HOLD,   // running minimum, rising at hold_decay dB/s
+};
+
+struct average {
+    enum averaging mode;
+    int number_of_bins;
+    int frames;                 // frames in the linear average
+    double hold_decay;          // dB/s
+    sample_t *avg_l, *avg_r;    // the running result
+    // last frames and their sum, for the linear average
+    sample_t *ring_l, *ring_r;
+    double *sum_l, *sum_r;
+    int head, filled;
+    // capture time and band of the last frame; a change of band restarts the average
+    unsigned long long t;
+    double f_lo, f_hi;
+    bool primed;
+};
+
+bool average_mode(const char *name, enum averaging *mode);
+
+void average_init(struct average *v, enum averaging mode, int number_of_bins, int frames, double hold_decay);
+
+void average_frame(struct average *v, sample_t *bins_l, sample_t *bins_r,
+        unsigned long long t, unsigned int rate, double f_lo, double f_hi);
+
+void average_free(struct average *v);
@@ -0,0 +1,126 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis/cqt.h"
+#include "analysis/weighting.h"
+#include "sigproc.h"
+
+#include "debug.h"
+#include "util.h"
+
+
+void cqt_init(struct cqt *c, int size, int bins_per_octave) {
+    memset(c, 0, sizeof(*c));
+    c->size = size;
+    c->bins_per_octave = bins_per_octave;
+    c->bins = (int)ceil(bins_per_octave * log2((double)UPPER_CUTOFF_FREQ / LOWER_CUTOFF_FREQ));
+    c->start = calloc(c->bins + 1, sizeof(int));
+    c->weight = calloc(c->bins, sizeof(sample_t));
+}
+
+// centre frequency of bin k; the bins tile the cutoff range evenly in log frequency,
+// as the bars are drawn
+static double cqt_frequency(const struct cqt *c, int k) {
+    return LOWER_CUTOFF_FREQ * pow((double)UPPER_CUTOFF_FREQ / LOWER_CUTOFF_FREQ, (k + 0.5) / c->bins);
+}
+
+// scale each bin's power to match make_bins(), with the weighting w
+static void cqt_weights(struct cqt *c, const struct weighting *w) {
+    int imin, imax;
+    bin_range(c->size, c->rate, &imin, &imax);
+    for (int k = 0; k < c->bins; k++) {
+        double f = cqt_frequency(c, k);
+        // A sine gives |bin|^2 = (A / 4)^2 at any frequency, and 3 A^2 imax / 32 f in make_bins()
+        c->weight[k] = 1.5 * imax / f * weighting_gain(w, f);
+    }
+    c->generation = w ? w->generation : 0;
+}
+
+// compute the sparse kernel for this rate, and the weights for w; true if the kernel changed
+bool cqt_range(struct cqt *c, unsigned int rate, const struct weighting *w) {
+    if (rate == c->rate) {
+        if ((w ? w->generation : 0) != c->generation) {
+            cqt_weights(c, w);
+        }
+        return false;
+    }
+    c->rate = rate;
+    int n = c->size;
+    // Q of adjacent bins one bin width apart
+    double q = 1.0 / (pow((double)UPPER_CUTOFF_FREQ / LOWER_CUTOFF_FREQ, 1.0 / c->bins) - 1);
+
+    fft_complex *t = FFTW(alloc_complex)(n);
+    fft_complex *k_t = FFTW(alloc_complex)(n);
+    fft_plan plan = FFTW(plan_dft_1d)(n, t, k_t, FFTW_FORWARD, FFTW_ESTIMATE);
+    int capacity = 16 * c->bins, used = 0;
+    c->index = realloc(c->index, capacity * sizeof(int));
+    c->re = realloc(c->re, capacity * sizeof(sample_t));
+    c->im = realloc(c->im, capacity * sizeof(sample_t));
+
+    for (int k = 0; k < c->bins; k++) {
+        double f = cqt_frequency(c, k);
+        // Q cycles of f, or the whole history in the bass where that would be longer
+        int length = min(n, (int)ceil(q * rate / f));
+        // Hann windowed exponential over the newest length samples, unit gain
+        memset(t, 0, n * sizeof(fft_complex));
+        for (int m = 0; m < length; m++) {
+            double w = (0.5 - 0.5 * cos(2 * M_PI * m / length)) / length;
+            t[n - length + m][0] = w * cos(2 * M_PI * f * m / rate);
+            t[n - length + m][1] = w * sin(2 * M_PI * f * m / rate);
+        }
+        FFTW(execute)(plan);
+
+        // keep the coefficients that matter; by Parseval the bin is sum X conj(K) / n,
+        // and only the positive frequencies of a real input are in the r2c output
+        double peak = 0;
+        for (int j = 0; j <= n / 2; j++) {
+            peak = fmax(peak, hypot(k_t[j][0], k_t[j][1]));
+        }
+        c->start[k] = used;
+        for (int j = 0; j <= n / 2; j++) {
+            if (hypot(k_t[j][0], k_t[j][1]) < CQT_THRESHOLD * peak) {
+                continue;
+            }
+            if (used == capacity) {
+                capacity *= 2;
+                c->index = realloc(c->index, capacity * sizeof(int));
+                c->re = realloc(c->re, capacity * sizeof(sample_t));
+                c->im = realloc(c->im, capacity * sizeof(sample_t));
+            }
+            c->index[used] = j;
+            c->re[used] = k_t[j][0] / n;
+            c->im[used] = -k_t[j][1] / n;
+            used++;
+        }
+    }
+    c->start[c->bins] = used;
+    cqt_weights(c, w);
+
+    FFTW(destroy_plan)(plan);
+    FFTW(free)(t);
+    FFTW(free)(k_t);
+    debug("cqt: %d bins, %d kernel coefficients\n", c->bins, used);
+    return true;
+}
+
+// power in each constant-Q bin, from the unwindowed transform of the history
+void cqt_bins(const struct cqt *c, const fft_complex *out, sample_t *bins) {
+    for (int k = 0; k < c->bins; k++) {
+        sample_t re = 0, im = 0;
+        for (int j = c->start[k]; j < c->start[k + 1]; j++) {
+            const sample_t *x = out[c->index[j]];
+            re += x[0] * c->re[j] - x[1] * c->im[j];
+            im += x[0] * c->im[j] + x[1] * c->re[j];
+        }
+        bins[k] = (re * re + im * im) * c->weight[k];
+    }
+}
+
+void cqt_free(struct cqt *c) {
+    free(c->start);
+    free(c->index);
+    free(c->re);
+    free(c->im);
+    free(c->weight);
+}
@@ -0,0 +1,35 @@
+// Constant-Q transform by sparse spectral kernel (Brown and Puckette):
+// each log-spaced bin is the inner product of one FFT of the history with the
+// few transform bins its windowed complex exponential occupies.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "input/common.h"
+
+struct weighting;
+
+// kernel coefficients smaller than this, relative to the bin's largest, are dropped
+#define CQT_THRESHOLD 0.0054
+
+struct cqt {
+    int size;                   // length of the FFT the kernel applies to
+    int bins;                   // log-spaced bins between the cutoff frequencies
+    int bins_per_octave;
+    unsigned int rate;
+    unsigned int generation;    // of the weighting in the weights
+    // sparse kernel, by row: bin k sums out[index[j]] * kernel[j] for start[k] <= j < start[k + 1]
+    int *start;
+    int *index;
+    sample_t *re, *im;
+    sample_t *weight;           // scale of bin k's power, to match make_bins()
+};
+
+void cqt_init(struct cqt *c, int size, int bins_per_octave);
+
+bool cqt_range(struct cqt *c, unsigned int rate, const struct weighting *w);
+
+void cqt_bins(const struct cqt *c, const fft_complex *out, sample_t *bins);
+
+void cqt_free(struct cqt *c);
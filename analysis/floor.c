@@ -0,0 +1,103 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis/floor.h"
+
+#include "debug.h"
+#include "util.h"
+
+
+void floor_init(struct noise_floor *fl, int number_of_bins) {
+    memset(fl, 0, sizeof(*fl));
+    fl->number_of_bins = number_of_bins;
+    fl->bias_l = calloc(number_of_bins, sizeof(sample_t));
+    fl->bias_r = calloc(number_of_bins, sizeof(sample_t));
+    fl->current_l = calloc(number_of_bins, sizeof(sample_t));
+    fl->current_r = calloc(number_of_bins, sizeof(sample_t));
+    fl->sub_l = calloc((size_t)(FLOOR_SUBWINDOWS - 1) * number_of_bins, sizeof(sample_t));
+    fl->sub_r = calloc((size_t)(FLOOR_SUBWINDOWS - 1) * number_of_bins, sizeof(sample_t));
+    fl->sub_min_l = calloc(number_of_bins, sizeof(sample_t));
+    fl->sub_min_r = calloc(number_of_bins, sizeof(sample_t));
+    fl->floor_l = calloc(number_of_bins, sizeof(sample_t));
+    fl->floor_r = calloc(number_of_bins, sizeof(sample_t));
+}
+
+// fold a frame into the subwindow minimum, average the noise's distance above the minimum
+// with weight 1 - alpha, and set the floor from them
+static void floor_track(int n, sample_t alpha, const sample_t *restrict x, sample_t *restrict current,
+        const sample_t *restrict sub_min, sample_t *restrict bias, sample_t *restrict floor) {
+    for (int i = 0; i < n; i++) {
+        current[i] = x[i] < current[i] ? x[i] : current[i];
+        sample_t m = current[i] < sub_min[i] ? current[i] : sub_min[i];
+        sample_t d = x[i] - m;
+        bias[i] = d < FLOOR_GATE ? alpha * bias[i] + (1 - alpha) * d : bias[i];
+        floor[i] = m + bias[i];
+    }
+}
+
+// retire the subwindow in progress into the ring, and take the minimum of the ring
+static void floor_retire(struct noise_floor *fl, sample_t *sub, sample_t *sub_min, sample_t *current) {
+    int n = fl->number_of_bins;
+    memcpy(sub + (size_t)fl->head * n, current, n * sizeof(sample_t));
+    memcpy(sub_min, sub, n * sizeof(sample_t));
+    for (int s = 1; s < fl->filled; s++) {
+        const sample_t *restrict m = sub + (size_t)s * n;
+        for (int i = 0; i < n; i++) {
+            sub_min[i] = m[i] < sub_min[i] ? m[i] : sub_min[i];
+        }
+    }
+}
+
+// track the floor under the frame in dB at capture time t
+void floor_frame(struct noise_floor *fl, const sample_t *bins_l, const sample_t *bins_r,
+        unsigned long long t, unsigned int rate, double f_lo, double f_hi) {
+    int n = fl->number_of_bins;
+    if (rate == 0) {
+        return;
+    }
+    if (!fl->primed || f_lo != fl->f_lo || f_hi != fl->f_hi) {
+        // start from this frame, with nothing completed
+        memcpy(fl->current_l, bins_l, n * sizeof(sample_t));
+        memcpy(fl->current_r, bins_r, n * sizeof(sample_t));
+        for (int i = 0; i < n; i++) {
+            fl->sub_min_l[i] = fl->sub_min_r[i] = INFINITY;
+        }
+        memset(fl->bias_l, 0, n * sizeof(sample_t));
+        memset(fl->bias_r, 0, n * sizeof(sample_t));
+        fl->head = 0;
+        fl->filled = 0;
+        fl->start = t;
+        fl->t = t;
+        fl->f_lo = f_lo;
+        fl->f_hi = f_hi;
+        fl->primed = true;
+    }
+    if (t - fl->start >= (unsigned long long)(FLOOR_WINDOW * rate / FLOOR_SUBWINDOWS)) {
+        fl->filled = min(fl->filled + 1, FLOOR_SUBWINDOWS - 1);
+        floor_retire(fl, fl->sub_l, fl->sub_min_l, fl->current_l);
+        floor_retire(fl, fl->sub_r, fl->sub_min_r, fl->current_r);
+        fl->head = (fl->head + 1) % (FLOOR_SUBWINDOWS - 1);
+        memcpy(fl->current_l, bins_l, n * sizeof(sample_t));
+        memcpy(fl->current_r, bins_r, n * sizeof(sample_t));
+        fl->start = t;
+    }
+    // the distance is averaged over the window, in audio time
+    sample_t alpha = exp(-(double)(t - fl->t) / (FLOOR_WINDOW * rate));
+    fl->t = t;
+    floor_track(n, alpha, bins_l, fl->current_l, fl->sub_min_l, fl->bias_l, fl->floor_l);
+    floor_track(n, alpha, bins_r, fl->current_r, fl->sub_min_r, fl->bias_r, fl->floor_r);
+}
+
+void floor_free(struct noise_floor *fl) {
+    free(fl->current_l);
+    free(fl->current_r);
+    free(fl->sub_l);
+    free(fl->sub_r);
+    free(fl->sub_min_l);
+    free(fl->sub_min_r);
+    free(fl->bias_l);
+    free(fl->bias_r);
+    free(fl->floor_l);
+    free(fl->floor_r);
+}
@@ -0,0 +1,42 @@
+// Noise floor tracking by minimum statistics (Martin, 2001): the floor of each bin is
+// the minimum of its averaged level over the last FLOOR_WINDOW seconds, raised by the
+// bin's typical distance of that minimum below the noise, which depends on how many
+// transform bins the display bin sums and on the averaging.
+// The window is split into FLOOR_SUBWINDOWS, so a frame costs a compare per bin, and the
+// end of each subwindow one pass over the subwindow minima.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "util.h"
+
+// seconds of history the minimum is taken over; longer than most sustained notes
+#define FLOOR_WINDOW 1.5
+#define FLOOR_SUBWINDOWS 6
+// levels further above the minimum than this (dB) are taken as signal, not noise
+#define FLOOR_GATE 20
+
+struct noise_floor {
+    int number_of_bins;
+    // minimum of the subwindow in progress, and of the completed ones, per bin
+    sample_t *current_l, *current_r;
+    sample_t *sub_l, *sub_r;    // [subwindow][bin], the last FLOOR_SUBWINDOWS - 1
+    sample_t *sub_min_l, *sub_min_r;
+    int head, filled;
+    // mean distance of the noise above the minimum, per bin
+    sample_t *bias_l, *bias_r;
+    // the floor of each bin in dB
+    sample_t *floor_l, *floor_r;
+    // capture time the subwindow in progress started, and the band; a change of band restarts
+    unsigned long long start, t;
+    double f_lo, f_hi;
+    bool primed;
+};
+
+void floor_init(struct noise_floor *fl, int number_of_bins);
+
+void floor_frame(struct noise_floor *fl, const sample_t *bins_l, const sample_t *bins_r,
+        unsigned long long t, unsigned int rate, double f_lo, double f_hi);
+
+void floor_free(struct noise_floor *fl);
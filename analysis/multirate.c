@@ -0,0 +1,195 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis/multirate.h"
+#include "analysis/weighting.h"
+#include "sigproc.h"
+
+#include "debug.h"
+#include "util.h"
+
+
+// zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double bessel_i0(double x) {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 32; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// Kaiser windowed sinc half-band low pass, cut off at a quarter of the input rate.
+// Passband to 0.2 and stopband from 0.3 of the input rate, about 80dB down.
+void halfband_design(sample_t *h) {
+    const int c = HALFBAND_TAPS / 2;
+    const double beta = 7.86;
+    double sum = 0;
+    for (int n = 0; n < HALFBAND_TAPS; n++) {
+        int j = n - c;
+        double r = (double)j / c;
+        if (j == 0) {
+            h[n] = 0.5;
+        } else if (j % 2) {
+            h[n] = sin(M_PI * j / 2) / (M_PI * j) * bessel_i0(beta * sqrt(1 - r * r)) / bessel_i0(beta);
+        } else {
+            // every other tap of a half-band filter is zero
+            h[n] = 0;
+        }
+        sum += h[n];
+    }
+    // unity gain at DC
+    for (int n = 0; n < HALFBAND_TAPS; n++) {
+        h[n] /= sum;
+    }
+}
+
+void multirate_init(struct multirate *m, int equivalent) {
+    memset(m, 0, sizeof(*m));
+    m->size = min(MULTIRATE_SIZE, equivalent);
+    m->equivalent = equivalent;
+    // halve the rate until the lowest band resolves as finely as one equivalent transform
+    m->bands = 1;
+    while ((m->size << (m->bands - 1)) < equivalent) {
+        m->bands++;
+    }
+    halfband_design(m->halfband);
+
+    int n = m->size / 2 + 1;
+    m->band = calloc(m->bands, sizeof(struct multirate_band));
+    for (int s = 0; s < m->bands; s++) {
+        struct multirate_band *b = &m->band[s];
+        b->decimation = 1 << s;
+        b->hist_l = calloc(m->size, sizeof(sample_t));
+        b->hist_r = calloc(m->size, sizeof(sample_t));
+        b->fir_l = calloc(2 * HALFBAND_TAPS, sizeof(sample_t));
+        b->fir_r = calloc(2 * HALFBAND_TAPS, sizeof(sample_t));
+        // octave [LOW, HIGH) of the band's rate; the top band runs to its Nyquist
+        // frequency and the bottom one down to DC
+        b->kmin = s == m->bands - 1 ? 1 : (int)ceil(MULTIRATE_LOW * m->size);
+        b->kmax = s == 0 ? n : (int)ceil(MULTIRATE_HIGH * m->size);
+        b->power_l = calloc(n, sizeof(sample_t));
+        b->power_r = calloc(n, sizeof(sample_t));
+        b->bin = calloc(n, sizeof(int));
+        b->weight = calloc(n, sizeof(sample_t));
+    }
+
+    m->windowed = FFTW(alloc_real)(m->size);
+    m->out = FFTW(alloc_complex)(n);
+    m->plan = fft_plan_r2c(m->size, m->windowed, m->out);
+    debug("multirate: %d bands of %d points, as fine as %d points\n", m->bands, m->size, equivalent);
+}
+
+// feed full rate samples down the decimator chain
+void multirate_push(struct multirate *m, const sample_t *in_l, const sample_t *in_r, int samples) {
+    const sample_t *h = m->halfband;
+    for (int i = 0; i < samples; i++) {
+        sample_t x_l = in_l[i];
+        sample_t x_r = in_r[i];
+        for (int s = 0; s < m->bands; s++) {
+            struct multirate_band *b = &m->band[s];
+            b->hist_l[b->index] = x_l;
+            b->hist_r[b->index] = x_r;
+            if (++b->index == m->size)
+                b->index = 0;
+            if (s == m->bands - 1)
+                break;
+            b->fir_l[b->fir_index] = b->fir_l[b->fir_index + HALFBAND_TAPS] = x_l;
+            b->fir_r[b->fir_index] = b->fir_r[b->fir_index + HALFBAND_TAPS] = x_r;
+            if (++b->fir_index == HALFBAND_TAPS)
+                b->fir_index = 0;
+            // the next band takes every other filtered sample
+            b->odd = !b->odd;
+            if (b->odd)
+                break;
+            x_l = halfband(h, b->fir_l + b->fir_index);
+            x_r = halfband(h, b->fir_r + b->fir_index);
+        }
+    }
+}
+
+// place each band's transform bins in the log-spaced display bins make_bins() would use
+// for one transform of the equivalent length, with the same scaling and the weighting w
+static void multirate_range(struct multirate *m, unsigned int rate, const struct weighting *w, int number_of_bins) {
+    int imin, imax;
+    unsigned int generation = w ? w->generation : 0;
+    if (rate == m->rate && number_of_bins == m->number_of_bins && generation == m->generation) {
+        return;
+    }
+    m->rate = rate;
+    m->number_of_bins = number_of_bins;
+    m->generation = generation;
+    bin_range(m->equivalent, rate, &imin, &imax);
+    for (int s = 0; s < m->bands; s++) {
+        struct multirate_band *b = &m->band[s];
+        for (int k = b->kmin; k < b->kmax; k++) {
+            // the frequency of k as a bin of the equivalent transform
+            double i = (double)k * m->equivalent / ((double)m->size * b->decimation);
+            if (i < imin || i >= imax) {
+                b->bin[k] = -1;
+                continue;
+            }
+            b->bin[k] = min(number_of_bins - 1, (int)(number_of_bins * (log(i) - log(imin)) / (log(imax) - log(imin))));
+            // 1/f for a log f ordinate; a band at 1/d of the rate has 1/d of the noise power per bin
+            b->weight[k] = (sample_t)b->decimation * imax / ((double)k * m->size * rate)
+                * weighting_gain(w, i * rate / m->equivalent);
+        }
+    }
+}
+
+// power spectrum of one channel's band history
+static void multirate_transform(struct multirate *m, struct multirate_band *b, const sample_t *hist, sample_t *power) {
+    window(hist, b->index, m->windowed, m->size, HANN);
+    FFTW(execute)(m->plan);
+    for (int k = b->kmin; k < b->kmax; k++) {
+        power[k] = m->out[k][0] * m->out[k][0] + m->out[k][1] * m->out[k][1];
+    }
+}
+
+// transform the bands that are due and stitch all of them into the display bins
+void multirate_frame(struct multirate *m, unsigned int rate, const struct weighting *w,
+        sample_t *bins_l, sample_t *bins_r, int number_of_bins) {
+    multirate_range(m, rate, w, number_of_bins);
+    for (int s = 0; s < m->bands; s++) {
+        struct multirate_band *b = &m->band[s];
+        // a band at 1/d of the rate has new samples for a transform every d frames,
+        // so every band sees the same overlap
+        if (m->frames % b->decimation == 0) {
+            multirate_transform(m, b, b->hist_l, b->power_l);
+            multirate_transform(m, b, b->hist_r, b->power_r);
+        }
+    }
+    m->frames++;
+
+    memset(bins_l, 0, number_of_bins * sizeof(sample_t));
+    memset(bins_r, 0, number_of_bins * sizeof(sample_t));
+    for (int s = 0; s < m->bands; s++) {
+        const struct multirate_band *b = &m->band[s];
+        for (int k = b->kmin; k < b->kmax; k++) {
+            int n = b->bin[k];
+            if (n >= 0) {
+                bins_l[n] += b->power_l[k] * b->weight[k];
+                bins_r[n] += b->power_r[k] * b->weight[k];
+            }
+        }
+    }
+}
+
+void multirate_free(struct multirate *m) {
+    for (int s = 0; s < m->bands; s++) {
+        struct multirate_band *b = &m->band[s];
+        free(b->hist_l);
+        free(b->hist_r);
+        free(b->fir_l);
+        free(b->fir_r);
+        free(b->power_l);
+        free(b->power_r);
+        free(b->bin);
+        free(b->weight);
+    }
+    free(m->band);
+    FFTW(free)(m->windowed);
+    FFTW(free)(m->out);
+    FFTW(destroy_plan)(m->plan);
+}
@@ -0,0 +1,75 @@
+// Multirate analysis: the input is split into octave bands by a chain of half-band
+// decimators, and each band gets a short FFT at its own sample rate.
+// The top octave gets a short window for a fast response, and the lowest band
+// gets the frequency resolution of a transform of the configured fft_size.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "input/common.h"
+
+struct weighting;
+
+// transform length of every band
+#define MULTIRATE_SIZE 1024
+// half-band filter length, 4k + 3 so the outermost taps are nonzero
+#define HALFBAND_TAPS 51
+// each band is used between these fractions of its own sample rate,
+// clear of the half-band filter's transition and the aliasing folded onto it
+#define MULTIRATE_LOW 0.2
+#define MULTIRATE_HIGH 0.4
+
+struct multirate_band {
+    int decimation;             // band sample rate is rate / decimation
+    // last size samples at the band's rate, oldest at index
+    sample_t *hist_l, *hist_r;
+    int index;
+    // half-band filter delay line for the next band, written twice so the taps read contiguously
+    sample_t *fir_l, *fir_r;
+    int fir_index;
+    bool odd;                   // the next sample in is dropped by the decimation
+    // power spectrum of the last transform, and its place in the display bins
+    int kmin, kmax;             // transform bins this band contributes, kmin <= k < kmax
+    sample_t *power_l, *power_r;
+    int *bin;                   // display bin of transform bin k, or -1
+    sample_t *weight;           // scale of transform bin k into its display bin
+};
+
+struct multirate {
+    int size;                   // transform length of every band
+    int equivalent;             // single transform length the display layout matches
+    int bands;
+    unsigned int rate;
+    int number_of_bins;
+    unsigned int generation;    // of the weighting in the weights
+    unsigned long frames;
+    struct multirate_band *band;
+    sample_t halfband[HALFBAND_TAPS];
+    // transform working space, shared by the bands
+    sample_t *windowed;
+    fft_complex *out;
+    fft_plan plan;
+};
+
+void halfband_design(sample_t *h);
+
+// one output sample of the half-band filter over taps x, oldest first
+static inline sample_t halfband(const sample_t *h, const sample_t *x) {
+    // symmetric, and zero at even offsets from the centre other than the centre itself
+    const int c = HALFBAND_TAPS / 2;
+    sample_t y = h[c] * x[c];
+    for (int j = 1; j <= c; j += 2) {
+        y += h[c + j] * (x[c - j] + x[c + j]);
+    }
+    return y;
+}
+
+void multirate_init(struct multirate *m, int equivalent);
+
+void multirate_push(struct multirate *m, const sample_t *in_l, const sample_t *in_r, int samples);
+
+void multirate_frame(struct multirate *m, unsigned int rate, const struct weighting *w,
+        sample_t *bins_l, sample_t *bins_r, int number_of_bins);
+
+void multirate_free(struct multirate *m);
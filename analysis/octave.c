@@ -0,0 +1,231 @@
+#include <complex.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis/octave.h"
+#include "sigproc.h"
+
+#include "debug.h"
+#include "util.h"
+
+
+// IEC 61260-1 base-ten octave ratio
+#define OCTAVE_G 1.9952623149688795
+
+void octave_init(struct octave *o, int fraction, double tau) {
+    memset(o, 0, sizeof(*o));
+    o->fraction = fraction;
+    o->tau = tau;
+    halfband_design(o->halfband);
+
+    // mid-band frequencies 1kHz G^(x / b) for odd b and G^((2x + 1) / 2b) for even b,
+    // between the cutoff frequencies
+    double offset = fraction % 2 ? 0 : 0.5;
+    int xmin = (int)ceil(fraction * log(LOWER_CUTOFF_FREQ / 1000.0) / log(OCTAVE_G) - offset);
+    int xmax = (int)floor(fraction * log(UPPER_CUTOFF_FREQ / 1000.0) / log(OCTAVE_G) - offset);
+    o->bands = xmax - xmin + 1;
+    o->centre = malloc(o->bands * sizeof(double));
+    for (int n = 0; n < o->bands; n++) {
+        o->centre[n] = 1000 * pow(OCTAVE_G, (xmin + n + offset) / fraction);
+    }
+    o->level_l = calloc(o->bands, sizeof(sample_t));
+    o->level_r = calloc(o->bands, sizeof(sample_t));
+    pthread_mutex_init(&o->lock, NULL);
+    debug("octave: %d 1/%d octave bands, %.1f to %.1fHz\n", o->bands, fraction, o->centre[0], o->centre[o->bands - 1]);
+}
+
+// lower and upper band edge frequencies of the whole bank
+void octave_edges(const struct octave *o, double *lo, double *hi) {
+    *lo = o->centre[0] * pow(OCTAVE_G, -0.5 / o->fraction);
+    *hi = o->centre[o->bands - 1] * pow(OCTAVE_G, 0.5 / o->fraction);
+}
+
+static void octave_group_free(struct octave_group *g) {
+    free(g->b0);
+    free(g->a1);
+    free(g->a2);
+    free(g->s1);
+    free(g->s2);
+    free(g->x);
+    free(g->ms);
+}
+
+// store the section with poles z1 and z2, and zeros at DC and Nyquist, with unity gain at e
+static void octave_section(struct octave_group *g, int section, int l, int r,
+        double complex z1, double complex z2, double complex e) {
+    double a1 = -creal(z1 + z2);
+    double a2 = creal(z1 * z2);
+    double b0 = 1 / cabs((1 - e * e) / (1 + a1 * e + a2 * e * e));
+    int i = section * g->lanes;
+    g->b0[i + l] = g->b0[i + r] = b0;
+    g->a1[i + l] = g->a1[i + r] = a1;
+    g->a2[i + l] = g->a2[i + r] = a2;
+}
+
+// Butterworth band-pass sections for band f1 to f2 Hz at this rate, into lanes l and r
+static void octave_band_design(struct octave_group *g, int l, int r, double f1, double f2, double rate) {
+    // prewarped analogue edges, and the band-pass transform of the low-pass prototype poles
+    double w1 = 2 * rate * tan(M_PI * f1 / rate);
+    double w2 = 2 * rate * tan(M_PI * f2 / rate);
+    double w0 = sqrt(w1 * w2);
+    double bw = w2 - w1;
+    // the digital frequency the analogue centre maps to, where the gain is unity
+    double complex e = cexp(-I * 2 * atan(w0 / (2 * rate)));
+    int section = 0;
+    // prototype poles in the upper half plane; the rest are their conjugates
+    for (int k = 0; 2 * k < OCTAVE_SECTIONS; k++) {
+        double complex p = cexp(I * M_PI * (2 * k + OCTAVE_SECTIONS + 1) / (2 * OCTAVE_SECTIONS));
+        double complex root = csqrt(p * bw * p * bw - 4 * w0 * w0);
+        double complex z[2];
+        for (int j = 0; j < 2; j++) {
+            double complex s = (p * bw + (j ? -root : root)) / 2;
+            z[j] = (1 + s / (2 * rate)) / (1 - s / (2 * rate));
+        }
+        if (2 * k + 1 == OCTAVE_SECTIONS) {
+            // the real prototype pole makes one section of both its poles,
+            // which are a conjugate pair, or both real for wide bands
+            octave_section(g, section++, l, r, z[0], z[1], e);
+        } else {
+            // a complex one makes a section of each of its poles and the conjugate
+            octave_section(g, section++, l, r, z[0], conj(z[0]), e);
+            octave_section(g, section++, l, r, z[1], conj(z[1]), e);
+        }
+    }
+}
+
+// assign the bands to decimated groups and design their filters for this rate
+static void octave_design(struct octave *o, unsigned int rate) {
+    int band_group[o->bands];
+    for (int s = 0; s < o->groups; s++) {
+        octave_group_free(&o->group[s]);
+    }
+    memset(o->group, 0, sizeof(o->group));
+    o->rate = rate;
+    o->groups = 1;
+
+    // each band runs in the lowest rate group that holds it clear of the half-band filters;
+    // bands at or above Nyquist are not run
+    for (int n = 0; n < o->bands; n++) {
+        double f2 = o->centre[n] * pow(OCTAVE_G, 0.5 / o->fraction);
+        int s = 0;
+        while (s + 1 < OCTAVE_GROUPS && f2 < OCTAVE_HEADROOM * rate / (2 << s)) {
+            s++;
+        }
+        band_group[n] = f2 < 0.49 * rate ? s : -1;
+        o->groups = max(o->groups, s + 1);
+    }
+    for (int s = 0; s < o->groups; s++) {
+        struct octave_group *g = &o->group[s];
+        g->first = o->bands;
+        for (int n = 0; n < o->bands; n++) {
+            if (band_group[n] == s) {
+                g->first = min(g->first, n);
+                g->bands++;
+            }
+        }
+        g->lanes = 2 * g->bands;
+        int size = max(1, OCTAVE_SECTIONS * g->lanes);
+        g->b0 = calloc(size, sizeof(sample_t));
+        g->a1 = calloc(size, sizeof(sample_t));
+        g->a2 = calloc(size, sizeof(sample_t));
+        g->s1 = calloc(size, sizeof(sample_t));
+        g->s2 = calloc(size, sizeof(sample_t));
+        g->x = calloc(max(1, g->lanes), sizeof(sample_t));
+        g->ms = calloc(max(1, g->lanes), sizeof(sample_t));
+        double group_rate = (double)rate / (1 << s);
+        g->alpha = exp(-1 / (o->tau * group_rate));
+        for (int b = 0; b < g->bands; b++) {
+            double f = o->centre[g->first + b];
+            octave_band_design(g, b, g->bands + b, f * pow(OCTAVE_G, -0.5 / o->fraction),
+                    f * pow(OCTAVE_G, 0.5 / o->fraction), group_rate);
+        }
+    }
+    debug("octave: %d groups at %uHz\n", o->groups, rate);
+}
+
+// one sample through every band of the group, left and right
+static void octave_group_sample(struct octave_group *g, sample_t x_l, sample_t x_r) {
+    const int lanes = g->lanes;
+    sample_t *restrict x = g->x;
+    sample_t *restrict ms = g->ms;
+    for (int i = 0; i < g->bands; i++) {
+        x[i] = x_l;
+        x[g->bands + i] = x_r;
+    }
+    for (int section = 0; section < OCTAVE_SECTIONS; section++) {
+        const sample_t *restrict b0 = g->b0 + section * lanes;
+        const sample_t *restrict a1 = g->a1 + section * lanes;
+        const sample_t *restrict a2 = g->a2 + section * lanes;
+        sample_t *restrict s1 = g->s1 + section * lanes;
+        sample_t *restrict s2 = g->s2 + section * lanes;
+        // transposed direct form II, y = b0 (x - x[-2]) filtered by the poles
+        for (int i = 0; i < lanes; i++) {
+            sample_t y = b0[i] * x[i] + s1[i];
+            s1[i] = s2[i] - a1[i] * y;
+            s2[i] = -b0[i] * x[i] - a2[i] * y;
+            x[i] = y;
+        }
+    }
+    const sample_t alpha = g->alpha;
+    for (int i = 0; i < lanes; i++) {
+        ms[i] = alpha * ms[i] + (1 - alpha) * x[i] * x[i];
+    }
+}
+
+// filter a block of interleaved stereo capture frames, on the capture thread
+void octave_push(struct octave *o, const int16_t *buf, int frames, unsigned int rate) {
+    if (!__atomic_load_n(&o->active, __ATOMIC_RELAXED) || rate == 0) {
+        return;
+    }
+    if (rate != o->rate) {
+        octave_design(o, rate);
+    }
+    const sample_t *h = o->halfband;
+    for (int i = 0; i < frames; i++) {
+        sample_t x_l = buf[2 * i];
+        sample_t x_r = buf[2 * i + 1];
+        for (int s = 0; s < o->groups; s++) {
+            struct octave_group *g = &o->group[s];
+            octave_group_sample(g, x_l, x_r);
+            if (s == o->groups - 1)
+                break;
+            g->fir_l[g->fir_index] = g->fir_l[g->fir_index + HALFBAND_TAPS] = x_l;
+            g->fir_r[g->fir_index] = g->fir_r[g->fir_index + HALFBAND_TAPS] = x_r;
+            if (++g->fir_index == HALFBAND_TAPS)
+                g->fir_index = 0;
+            // the next group takes every other filtered sample
+            g->odd = !g->odd;
+            if (g->odd)
+                break;
+            x_l = halfband(h, g->fir_l + g->fir_index);
+            x_r = halfband(h, g->fir_r + g->fir_index);
+        }
+    }
+
+    pthread_mutex_lock(&o->lock);
+    for (int s = 0; s < o->groups; s++) {
+        const struct octave_group *g = &o->group[s];
+        memcpy(o->level_l + g->first, g->ms, g->bands * sizeof(sample_t));
+        memcpy(o->level_r + g->first, g->ms + g->bands, g->bands * sizeof(sample_t));
+    }
+    pthread_mutex_unlock(&o->lock);
+}
+
+// copy out the latest mean square of each band, in capture units squared
+void octave_levels(struct octave *o, sample_t *level_l, sample_t *level_r) {
+    pthread_mutex_lock(&o->lock);
+    memcpy(level_l, o->level_l, o->bands * sizeof(sample_t));
+    memcpy(level_r, o->level_r, o->bands * sizeof(sample_t));
+    pthread_mutex_unlock(&o->lock);
+}
+
+void octave_free(struct octave *o) {
+    for (int s = 0; s < o->groups; s++) {
+        octave_group_free(&o->group[s]);
+    }
+    pthread_mutex_destroy(&o->lock);
+    free(o->centre);
+    free(o->level_l);
+    free(o->level_r);
+}
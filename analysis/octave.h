@@ -0,0 +1,62 @@
+// Fractional-octave band analyser (IEC 61260 base-ten bands, 1/1 to 1/12 octave),
+// run on the capture thread by a bank of streaming biquads.
+// The bands of each octave group run together at the lowest rate that still holds
+// them, fed by the half-band decimator chain from multirate.h. Within a group the
+// filter state is laid out as structure of arrays, with a lane per band and channel,
+// so every band and channel updates in one vectorised pass per sample.
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "input/common.h"
+#include "analysis/multirate.h"
+
+// Butterworth band-pass sections per band, 6th order overall
+#define OCTAVE_SECTIONS 3
+// at most this many decimated groups
+#define OCTAVE_GROUPS 10
+// a group holds bands whose upper edge is below this fraction of its rate
+#define OCTAVE_HEADROOM 0.2
+
+struct octave_group {
+    int bands;                  // bands in the group
+    int first;                  // band index of the group's first band
+    int lanes;                  // bands * 2 channels, left then right
+    // biquad coefficients and state per [section][lane]; b1 = 0 and b2 = -b0
+    sample_t *b0, *a1, *a2, *s1, *s2;
+    sample_t *x;                // per-lane working sample
+    sample_t *ms;               // time weighted mean square per lane
+    sample_t alpha;             // time weighting per sample at the group's rate
+    // half-band delay line feeding the next group, written twice
+    sample_t fir_l[2 * HALFBAND_TAPS], fir_r[2 * HALFBAND_TAPS];
+    int fir_index;
+    bool odd;
+};
+
+struct octave {
+    int fraction;               // bands per octave
+    int bands;
+    double *centre;             // exact mid-band frequencies, ascending
+    double tau;                 // time weighting in seconds
+    unsigned int rate;
+    int groups;
+    struct octave_group group[OCTAVE_GROUPS];
+    sample_t halfband[HALFBAND_TAPS];
+    // mean square per band, published to the renderer under the lock
+    sample_t *level_l, *level_r;
+    pthread_mutex_t lock;
+    int active;                 // set by the renderer while the bands are displayed
+};
+
+void octave_init(struct octave *o, int fraction, double tau);
+
+void octave_push(struct octave *o, const int16_t *buf, int frames, unsigned int rate);
+
+void octave_levels(struct octave *o, sample_t *level_l, sample_t *level_r);
+
+void octave_edges(const struct octave *o, double *lo, double *hi);
+
+void octave_free(struct octave *o);
@@ -0,0 +1,80 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "analysis/peaks.h"
+#include "sigproc.h"
+
+#include "util.h"
+
+
+// insert a peak at level in order into the found of at most k in peaks, dropping the
+// quietest if full; returns how many there are now
+static int peaks_insert(struct peak *peaks, int found, int k, double f, sample_t level) {
+    int j = found < k ? found++ : k - 1;
+    for (; j > 0 && peaks[j - 1].dB < level; j--) {
+        peaks[j] = peaks[j - 1];
+    }
+    peaks[j].f = f;
+    peaks[j].dB = level;
+    return found;
+}
+
+// The k loudest peaks of levels, transform bins kmin <= i < kmax in dB with bin i at
+// i * df Hz, merged into the found already in peaks, loudest first; returns how many
+// there are now. bar[i] is the display bin over transform bin i, whose floor a peak must
+// clear, or -1 where there is none.
+int peaks_find(const sample_t *levels, const int *bar, int kmin, int kmax, double df,
+        const sample_t *floor, struct peak *peaks, int found, int k) {
+    k = min(k, PEAKS_MAX);
+    for (int i = kmin + 1; i < kmax - 1; i++) {
+        sample_t a = levels[i - 1], y = levels[i], c = levels[i + 1];
+        if (bar[i] < 0 || y <= floor[bar[i]] + PEAKS_THRESHOLD || y <= a || y < c) {
+            continue;
+        }
+        if (found == k && y <= peaks[k - 1].dB) {
+            continue;
+        }
+        // vertex of the parabola through the three levels
+        double offset = 0.5 * (a - c) / (a - 2 * y + c);
+        found = peaks_insert(peaks, found, k, (i + offset) * df, y - 0.25 * (a - c) * offset);
+    }
+    return found;
+}
+
+// As peaks_find(), but on the number_of_bins display bins themselves, log-spaced from
+// f_lo to f_hi Hz, for transforms whose bins they are. Bins at DB_FLOOR are ones the
+// transform doesn't reach, so a peak beside one isn't interpolated.
+int peaks_find_bins(const sample_t *bins, const sample_t *floor, int number_of_bins,
+        double f_lo, double f_hi, struct peak *peaks, int k) {
+    int found = 0;
+    k = min(k, PEAKS_MAX);
+    for (int n = 1; n < number_of_bins - 1; n++) {
+        sample_t a = bins[n - 1], y = bins[n], c = bins[n + 1];
+        if (y <= floor[n] + PEAKS_THRESHOLD || y <= a || y < c) {
+            continue;
+        }
+        if (found == k && y <= peaks[k - 1].dB) {
+            continue;
+        }
+        double offset = 0;
+        sample_t level = y;
+        if (a > DB_FLOOR && c > DB_FLOOR) {
+            offset = 0.5 * (a - c) / (a - 2 * y + c);
+            level = y - 0.25 * (a - c) * offset;
+        }
+        // the bins are centred at n + 1/2 of number_of_bins steps in log frequency
+        found = peaks_insert(peaks, found, k, f_lo * pow(f_hi / f_lo, (n + offset + 0.5) / number_of_bins), level);
+    }
+    return found;
+}
+
+// the nearest equal tempered note to f, e.g. "A4+3" for 441.2Hz, into name
+void peaks_note(double f, char *name, int length) {
+    static const char *notes[] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+    // MIDI note number, A4 = 69
+    double m = 69 + 12 * log2(f / 440);
+    int note = (int)lround(m);
+    int cents = (int)lround(100 * (m - note));
+    snprintf(name, length, "%s%d%+d", notes[((note % 12) + 12) % 12], note / 12 - 1, cents);
+}
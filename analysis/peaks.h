@@ -0,0 +1,27 @@
+// Spectral peak picking in dB: the loudest local maxima that stand clear of the noise
+// floor under them, located between bins by a parabola through the peak bin and its
+// neighbours. Picked on the transform's own linear bins where there are any, since the
+// log-spaced display bins merge many of them above a few kHz; the constant-Q and zoom
+// transforms' display bins are their transform bins. One pass over a computed spectrum.
+
+#pragma once
+
+#include "util.h"
+
+// peaks kept per channel per frame
+#define PEAKS_MAX 8
+// a peak must stand this many dB above the floor under it
+#define PEAKS_THRESHOLD 10
+
+struct peak {
+    double f;                   // interpolated frequency in Hz
+    sample_t dB;                // interpolated level
+};
+
+int peaks_find(const sample_t *levels, const int *bar, int kmin, int kmax, double df,
+        const sample_t *floor, struct peak *peaks, int found, int k);
+
+int peaks_find_bins(const sample_t *bins, const sample_t *floor, int number_of_bins,
+        double f_lo, double f_hi, struct peak *peaks, int k);
+
+void peaks_note(double f, char *name, int length);
@@ -0,0 +1,121 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis/sdft.h"
+#include "sigproc.h"
+
+#include "debug.h"
+#include "util.h"
+
+
+void sdft_init(struct sdft *d, int size) {
+    int n = size / 2 + 1;
+    memset(d, 0, sizeof(*d));
+    d->size = size;
+    d->re_l = FFTW(alloc_real)(n);
+    d->im_l = FFTW(alloc_real)(n);
+    d->re_r = FFTW(alloc_real)(n);
+    d->im_r = FFTW(alloc_real)(n);
+    d->c = FFTW(alloc_real)(n);
+    d->s = FFTW(alloc_real)(n);
+    memset(d->re_l, 0, n * sizeof(sample_t));
+    memset(d->im_l, 0, n * sizeof(sample_t));
+    memset(d->re_r, 0, n * sizeof(sample_t));
+    memset(d->im_r, 0, n * sizeof(sample_t));
+    for (int k = 0; k < n; k++) {
+        d->c[k] = cos(2 * M_PI * k / size);
+        d->s[k] = sin(2 * M_PI * k / size);
+    }
+    // resync before the first frame
+    d->slid = SDFT_RESYNC * size;
+}
+
+// track the bins make_bins() uses at this rate, plus one either side for the window;
+// true if the range changed, in which case a resync is due
+bool sdft_range(struct sdft *d, unsigned int rate) {
+    int imin, imax;
+    if (rate == d->rate) {
+        return false;
+    }
+    bin_range(d->size, rate, &imin, &imax);
+    d->rate = rate;
+    d->kmin = max(0, imin - 1);
+    d->kmax = min(d->size / 2 + 1, imax + 1);
+    d->slid = SDFT_RESYNC * d->size;
+    debug("sdft: tracking bins %d to %d\n", d->kmin, d->kmax);
+    return true;
+}
+
+// slide the transform along by the given samples, where delta = x_new - x_old
+void sdft_slide(struct sdft *d, const sample_t *delta_l, const sample_t *delta_r, int samples) {
+    // X_k <- (X_k + x_new - x_old) e^{j 2 pi k / size}
+    // Independent across k, so the inner loop vectorises.
+    sample_t *restrict re_l = d->re_l;
+    sample_t *restrict im_l = d->im_l;
+    sample_t *restrict re_r = d->re_r;
+    sample_t *restrict im_r = d->im_r;
+    const sample_t *restrict c = d->c;
+    const sample_t *restrict s = d->s;
+    sample_t re, im;
+    for (int m = 0; m < samples; m++) {
+        const sample_t dl = delta_l[m];
+        const sample_t dr = delta_r[m];
+        for (int k = d->kmin; k < d->kmax; k++) {
+            re = re_l[k] + dl;
+            im = im_l[k];
+            re_l[k] = re * c[k] - im * s[k];
+            im_l[k] = re * s[k] + im * c[k];
+            re = re_r[k] + dr;
+            im = im_r[k];
+            re_r[k] = re * c[k] - im * s[k];
+            im_r[k] = re * s[k] + im * c[k];
+        }
+    }
+    d->slid += samples;
+}
+
+// rounding in the twiddles accumulates, so replace the spectrum with a full FFT periodically
+bool sdft_due(const struct sdft *d) {
+    return d->slid >= SDFT_RESYNC * d->size;
+}
+
+// take the spectrum from a full (unwindowed) FFT of the same history
+void sdft_resync(struct sdft *d, const fft_complex *x_l, const fft_complex *x_r) {
+    for (int k = d->kmin; k < d->kmax; k++) {
+        d->re_l[k] = x_l[k][0];
+        d->im_l[k] = x_l[k][1];
+        d->re_r[k] = x_r[k][0];
+        d->im_r[k] = x_r[k][1];
+    }
+    d->slid = 0;
+}
+
+// Hann windowed spectrum, applied in the frequency domain:
+// Y_k = X_k / 2 - (X_{k-1} + X_{k+1}) / 4
+void sdft_hann(const struct sdft *d, fft_complex *out_l, fft_complex *out_r) {
+    int k, nyquist = d->size / 2;
+    for (k = d->kmin + 1; k < d->kmax - 1; k++) {
+        out_l[k][0] = 0.5 * d->re_l[k] - 0.25 * (d->re_l[k - 1] + d->re_l[k + 1]);
+        out_l[k][1] = 0.5 * d->im_l[k] - 0.25 * (d->im_l[k - 1] + d->im_l[k + 1]);
+        out_r[k][0] = 0.5 * d->re_r[k] - 0.25 * (d->re_r[k - 1] + d->re_r[k + 1]);
+        out_r[k][1] = 0.5 * d->im_r[k] - 0.25 * (d->im_r[k - 1] + d->im_r[k + 1]);
+    }
+    if (d->kmax == nyquist + 1) {
+        // X_{nyquist + 1} is the conjugate of X_{nyquist - 1}
+        k = nyquist;
+        out_l[k][0] = 0.5 * d->re_l[k] - 0.5 * d->re_l[k - 1];
+        out_l[k][1] = 0.5 * d->im_l[k];
+        out_r[k][0] = 0.5 * d->re_r[k] - 0.5 * d->re_r[k - 1];
+        out_r[k][1] = 0.5 * d->im_r[k];
+    }
+}
+
+void sdft_free(struct sdft *d) {
+    FFTW(free)(d->re_l);
+    FFTW(free)(d->im_l);
+    FFTW(free)(d->re_r);
+    FFTW(free)(d->im_r);
+    FFTW(free)(d->c);
+    FFTW(free)(d->s);
+}
@@ -0,0 +1,39 @@
+// Sliding DFT: updates the spectrum of the latest size samples per new sample,
+// for when the hop is small compared with the transform length.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "input/common.h"
+
+// slide this many transform lengths between full-FFT resyncs, to bound numerical drift
+#define SDFT_RESYNC 1
+// largest transform slid; every audible bin is updated on every sample, so the cost is
+// O(size) per sample, about 1700 complex multiplies per channel at 4096 points and 48kHz
+#define SDFT_SIZE_MAX 4096
+
+struct sdft {
+    int size;
+    unsigned int rate;
+    int kmin, kmax;             // bins tracked, kmin <= k < kmax
+    // unwindowed spectrum, oldest sample at n = 0, as structure of arrays
+    sample_t *re_l, *im_l, *re_r, *im_r;
+    // per-bin twiddle e^{+j 2 pi k / size}
+    sample_t *c, *s;
+    int slid;                   // samples slid since the last resync
+};
+
+void sdft_init(struct sdft *d, int size);
+
+bool sdft_range(struct sdft *d, unsigned int rate);
+
+void sdft_slide(struct sdft *d, const sample_t *delta_l, const sample_t *delta_r, int samples);
+
+bool sdft_due(const struct sdft *d);
+
+void sdft_resync(struct sdft *d, const fft_complex *x_l, const fft_complex *x_r);
+
+void sdft_hann(const struct sdft *d, fft_complex *out_l, fft_complex *out_r);
+
+void sdft_free(struct sdft *d);
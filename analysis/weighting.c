@@ -0,0 +1,87 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis/weighting.h"
+#include "sigproc.h"
+
+#include "debug.h"
+#include "util.h"
+
+
+// weighting curve by config name; false if the name is unknown
+bool weighting_curve(const char *name, enum weighting_curve *curve) {
+    if (!strcmp(name, "z")) {
+        *curve = WEIGHTING_Z;
+    } else if (!strcmp(name, "a")) {
+        *curve = WEIGHTING_A;
+    } else if (!strcmp(name, "c")) {
+        *curve = WEIGHTING_C;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void weighting_init(struct weighting *w, enum weighting_curve curve, const double *eq, int eq_points) {
+    static unsigned int generations = 0;
+    memset(w, 0, sizeof(*w));
+    w->curve = curve;
+    w->generation = __atomic_add_fetch(&generations, 1, __ATOMIC_RELAXED);
+    if (eq_points > 0 && eq) {
+        w->eq_points = eq_points;
+        w->eq = malloc(eq_points * sizeof(double));
+        memcpy(w->eq, eq, eq_points * sizeof(double));
+    }
+    debug("weighting: curve %d, %d EQ points\n", curve, eq_points);
+}
+
+// IEC 61672-1 analogue weightings, as power ratios normalised to unity at 1kHz
+static double weighting_curve_gain(enum weighting_curve curve, double f) {
+    const double f1 = 20.598997, f2 = 107.65265, f3 = 737.86223, f4 = 12194.217;
+    double f_2 = f * f;
+    double r;
+    switch (curve) {
+        case WEIGHTING_A:
+            r = f4 * f4 * f_2 * f_2 /
+                ((f_2 + f1 * f1) * sqrt((f_2 + f2 * f2) * (f_2 + f3 * f3)) * (f_2 + f4 * f4));
+            // +2.000dB
+            return r * r * 1.5848932;
+        case WEIGHTING_C:
+            r = f4 * f4 * f_2 / ((f_2 + f1 * f1) * (f_2 + f4 * f4));
+            // +0.062dB
+            return r * r * 1.0143800;
+        case WEIGHTING_Z:
+            break;
+    }
+    return 1;
+}
+
+// user EQ at f, interpolated in log frequency between its points, as a power ratio
+static double weighting_eq_gain(const struct weighting *w, double f) {
+    if (w->eq_points == 0) {
+        return 1;
+    }
+    double m = w->eq[0];
+    if (w->eq_points > 1 && f > LOWER_CUTOFF_FREQ) {
+        double x = (w->eq_points - 1) * log(f / LOWER_CUTOFF_FREQ) / log((double)UPPER_CUTOFF_FREQ / LOWER_CUTOFF_FREQ);
+        int j = min((int)x, w->eq_points - 2);
+        double t = fmin(x - j, 1);
+        m = (1 - t) * w->eq[j] + t * w->eq[j + 1];
+    }
+    return m * m;
+}
+
+// power gain of the weighting at f Hz; a null weighting is flat
+double weighting_gain(const struct weighting *w, double f) {
+    if (w == NULL) {
+        return 1;
+    }
+    return weighting_curve_gain(w->curve, f) * weighting_eq_gain(w, f);
+}
+
+void weighting_free(struct weighting *w) {
+    free(w->eq);
+    w->eq = NULL;
+    w->eq_points = 0;
+}
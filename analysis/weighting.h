@@ -0,0 +1,34 @@
+// Frequency weighting of the spectrum: the A and C curves of IEC 61672 (or none, Z),
+// times a user EQ curve from the [eq] section of the config.
+// Each transform folds the weighting into the per-bin scale it already applies while
+// binning, so a weighted spectrum costs nothing extra per frame.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "util.h"
+
+// [analysis] weighting in the config
+enum weighting_curve {
+    WEIGHTING_Z,        // flat
+    WEIGHTING_A,
+    WEIGHTING_C,
+};
+
+struct weighting {
+    enum weighting_curve curve;
+    // user EQ amplitude multipliers, spread evenly in log frequency over the cutoff range
+    double *eq;
+    int eq_points;
+    // distinct for every weighting initialised, so tables built from one can tell it changed
+    unsigned int generation;
+};
+
+bool weighting_curve(const char *name, enum weighting_curve *curve);
+
+void weighting_init(struct weighting *w, enum weighting_curve curve, const double *eq, int eq_points);
+
+double weighting_gain(const struct weighting *w, double f);
+
+void weighting_free(struct weighting *w);
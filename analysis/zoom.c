@@ -0,0 +1,169 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis/zoom.h"
+#include "analysis/weighting.h"
+#include "sigproc.h"
+
+#include "debug.h"
+#include "util.h"
+
+
+void zoom_init(struct zoom *z, int equivalent, int number_of_bins) {
+    memset(z, 0, sizeof(*z));
+    z->size = ZOOM_SIZE;
+    z->equivalent = equivalent;
+    z->number_of_bins = number_of_bins;
+    halfband_design(z->halfband);
+    z->re_l = calloc(z->size, sizeof(sample_t));
+    z->im_l = calloc(z->size, sizeof(sample_t));
+    z->re_r = calloc(z->size, sizeof(sample_t));
+    z->im_r = calloc(z->size, sizeof(sample_t));
+    z->bin = calloc(number_of_bins, sizeof(int));
+    z->weight = calloc(number_of_bins, sizeof(sample_t));
+    z->in = FFTW(alloc_complex)(z->size);
+    z->out = FFTW(alloc_complex)(z->size);
+    z->plan = fft_plan_dft(z->size, z->in, z->out);
+}
+
+// scale each display bin's power to read as make_bins() would, with the weighting w
+static void zoom_weights(struct zoom *z, const struct weighting *w) {
+    int imin, imax;
+    bin_range(z->equivalent, z->rate, &imin, &imax);
+    for (int n = 0; n < z->number_of_bins; n++) {
+        double f = z->lo * pow(z->hi / z->lo, (n + 0.5) / z->number_of_bins);
+        // a sine's peak bin is (A size / 4)^2
+        z->weight[n] = 1.5 * imax / (f * z->size * z->size) * weighting_gain(w, f);
+    }
+    z->generation = w ? w->generation : 0;
+}
+
+// retune to the band lo to hi Hz, weighted by w; true if the band changed, in which case the history restarts
+bool zoom_band(struct zoom *z, double lo, double hi, unsigned int rate, const struct weighting *w) {
+    if (rate == 0 || (lo == z->lo && hi == z->hi && rate == z->rate)) {
+        if (z->rate && (w ? w->generation : 0) != z->generation) {
+            zoom_weights(z, w);
+        }
+        return false;
+    }
+    z->lo = lo;
+    z->hi = hi;
+    z->rate = rate;
+
+    // decimate while the band still fits in the flat part of the last half-band filter
+    z->stages = 0;
+    while (z->stages < ZOOM_STAGES && 0.4 * rate / (2 << z->stages) >= (hi - lo) / 2) {
+        z->stages++;
+    }
+    double centre = (lo + hi) / 2;
+    double decimated = (double)rate / (1 << z->stages);
+    z->mix_re = 1;
+    z->mix_im = 0;
+    z->step_re = cos(2 * M_PI * centre / rate);
+    z->step_im = -sin(2 * M_PI * centre / rate);
+    memset(z->stage, 0, sizeof(z->stage));
+    memset(z->re_l, 0, z->size * sizeof(sample_t));
+    memset(z->im_l, 0, z->size * sizeof(sample_t));
+    memset(z->re_r, 0, z->size * sizeof(sample_t));
+    memset(z->im_r, 0, z->size * sizeof(sample_t));
+    z->index = 0;
+
+    // log-spaced display bins over the band, each the nearest transform bin;
+    // negative frequencies, below the centre, are in the top half of the transform
+    for (int n = 0; n < z->number_of_bins; n++) {
+        double f = lo * pow(hi / lo, (n + 0.5) / z->number_of_bins);
+        int k = (int)lround((f - centre) * z->size / decimated);
+        z->bin[n] = (k + z->size) % z->size;
+    }
+    zoom_weights(z, w);
+    debug("zoom: %.2f to %.2fHz, decimated by %d, %.3fHz resolution\n",
+            lo, hi, 1 << z->stages, decimated / z->size);
+    return true;
+}
+
+// capture samples between zoomed transforms
+int zoom_hop(const struct zoom *z, double overlap) {
+    // the configured overlap at the decimated rate, but often enough to look live
+    int hop = max(1, (int)(z->size * (1.0 - overlap))) << z->stages;
+    if (z->rate) {
+        hop = min(hop, (int)(z->rate / ZOOM_RATE));
+    }
+    return max(1, hop);
+}
+
+// mix full rate samples down to the band and decimate them into the history
+void zoom_push(struct zoom *z, const sample_t *in_l, const sample_t *in_r, int samples) {
+    const sample_t *h = z->halfband;
+    if (z->rate == 0) {
+        return;
+    }
+    for (int i = 0; i < samples; i++) {
+        sample_t v[4] = {in_l[i] * z->mix_re, in_l[i] * z->mix_im, in_r[i] * z->mix_re, in_r[i] * z->mix_im};
+        double re = z->mix_re * z->step_re - z->mix_im * z->step_im;
+        z->mix_im = z->mix_re * z->step_im + z->mix_im * z->step_re;
+        z->mix_re = re;
+
+        int s;
+        for (s = 0; s < z->stages; s++) {
+            struct zoom_stage *st = &z->stage[s];
+            for (int c = 0; c < 4; c++) {
+                st->fir[c][st->index] = st->fir[c][st->index + HALFBAND_TAPS] = v[c];
+            }
+            if (++st->index == HALFBAND_TAPS)
+                st->index = 0;
+            // the next stage takes every other filtered sample
+            st->odd = !st->odd;
+            if (st->odd)
+                break;
+            for (int c = 0; c < 4; c++) {
+                v[c] = halfband(h, st->fir[c] + st->index);
+            }
+        }
+        if (s == z->stages) {
+            z->re_l[z->index] = v[0];
+            z->im_l[z->index] = v[1];
+            z->re_r[z->index] = v[2];
+            z->im_r[z->index] = v[3];
+            if (++z->index == z->size)
+                z->index = 0;
+        }
+    }
+    // keep the mixer on the unit circle
+    double r = hypot(z->mix_re, z->mix_im);
+    z->mix_re /= r;
+    z->mix_im /= r;
+}
+
+// Hann windowed power spectrum of one channel's baseband history, into the display bins
+static void zoom_transform(struct zoom *z, const sample_t *re, const sample_t *im, sample_t *bins) {
+    const sample_t *w = window_table(z->size, HANN);
+    for (int n = 0, k = z->index; n < z->size; n++) {
+        z->in[n][0] = w[n] * re[k];
+        z->in[n][1] = w[n] * im[k];
+        if (++k == z->size)
+            k = 0;
+    }
+    FFTW(execute)(z->plan);
+    for (int n = 0; n < z->number_of_bins; n++) {
+        const sample_t *x = z->out[z->bin[n]];
+        bins[n] = (x[0] * x[0] + x[1] * x[1]) * z->weight[n];
+    }
+}
+
+void zoom_frame(struct zoom *z, sample_t *bins_l, sample_t *bins_r) {
+    zoom_transform(z, z->re_l, z->im_l, bins_l);
+    zoom_transform(z, z->re_r, z->im_r, bins_r);
+}
+
+void zoom_free(struct zoom *z) {
+    free(z->re_l);
+    free(z->im_l);
+    free(z->re_r);
+    free(z->im_r);
+    free(z->bin);
+    free(z->weight);
+    FFTW(free)(z->in);
+    FFTW(free)(z->out);
+    FFTW(destroy_plan)(z->plan);
+}
@@ -0,0 +1,61 @@
+// Zoom FFT: the band of interest is mixed down to DC, low-passed and decimated by a
+// chain of half-band filters, and a short complex FFT resolves just that band.
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "input/common.h"
+#include "analysis/multirate.h"
+
+struct weighting;
+
+// complex transform length over the band
+#define ZOOM_SIZE 512
+// at most this many half-band stages, a decimation of 2^20
+#define ZOOM_STAGES 20
+// at least this many zoomed transforms per second, whatever the band
+#define ZOOM_RATE 20
+// narrowest band in Hz
+#define ZOOM_MIN_WIDTH 1.0
+
+struct zoom_stage {
+    // delay lines of the left and right real and imaginary parts, written twice
+    sample_t fir[4][2 * HALFBAND_TAPS];
+    int index;
+    bool odd;
+};
+
+struct zoom {
+    int size;
+    int equivalent;             // single transform length whose level scaling to match
+    int number_of_bins;
+    double lo, hi;              // band in Hz
+    unsigned int rate;
+    int stages;                 // decimation is 2^stages
+    // mixer e^{-j 2 pi fc n / rate} and its per-sample step
+    double mix_re, mix_im, step_re, step_im;
+    struct zoom_stage stage[ZOOM_STAGES];
+    sample_t halfband[HALFBAND_TAPS];
+    // baseband history at rate / 2^stages, oldest at index
+    sample_t *re_l, *im_l, *re_r, *im_r;
+    int index;
+    // display bin n is transform bin bin[n], scaled by weight[n]
+    int *bin;
+    sample_t *weight;
+    unsigned int generation;    // of the weighting in the weights
+    fft_complex *in, *out;
+    fft_plan plan;
+};
+
+void zoom_init(struct zoom *z, int equivalent, int number_of_bins);
+
+bool zoom_band(struct zoom *z, double lo, double hi, unsigned int rate, const struct weighting *w);
+
+int zoom_hop(const struct zoom *z, double overlap);
+
+void zoom_push(struct zoom *z, const sample_t *in_l, const sample_t *in_r, int samples);
+
+void zoom_frame(struct zoom *z, sample_t *bins_l, sample_t *bins_r);
+
+void zoom_free(struct zoom *z);
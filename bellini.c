@@ -38,6 +38,9 @@
 #include "input/shmem.h"
 #include "input/sndio.h"
 
+#include "analysis/analysis.h"
+#include "analysis/octave.h"
+
 #include "output/sdlplot.h"
 #include "output/vis.h"
 
@@ -74,9 +77,9 @@ void sig_handler(int sig_no) {
     raise(sig_no);
 }
 
-// config: reloader
+// config: reloader; true if the config was reloaded
 // TODO: move to config.c
-void check_config_changed(char *configPath,
+bool check_config_changed(char *configPath,
         rgba *plot_l_c, rgba *plot_r_c,
         rgba *ax_c, rgba *ax2_c,
         rgba *text_c, rgba *audio_c, rgba *osc_c) {
@@ -113,9 +116,25 @@ void check_config_changed(char *configPath,
                 audio_c->r = r; audio_c->g = g; audio_c->b = b;
                 sscanf(p.osc_col, "#%02x%02x%02x", &r, &g, &b);
                 osc_c->r = r; osc_c->g = g; osc_c->b = b;
+                return true;
             }
         }
     }
+    return false;
+}
+
+// plan every configured transform size and save the wisdom, e.g. at install time
+int fft_plan_only(struct config_params *p) {
+    struct audio_data audio;
+    struct analysis analysis;
+    debug("planning %d point transforms with '%s' planner\n", p->fft_size, p->planner);
+    audio_init(&audio, p->audio_source, DEFAULT_FFT_SIZE);
+    analysis_init(&analysis, &audio, p, 1);
+    // save before cleanup, which forgets the wisdom
+    bool saved = fft_wisdom_save();
+    analysis_cleanup(&analysis);
+    audio_cleanup(&audio, true);
+    return saved ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 #ifdef ALSA
@@ -145,7 +164,9 @@ Visualize audio input. \n\
 \n\
 Options:\n\
 	-p          path to config file\n\
+	-b          benchmark the FFT pipeline and exit\n\
 	-v          print version\n\
+	--plan-only generate FFTW wisdom for the configured transforms and exit\n\
 \n\
 All options are specified in config file, see in '/home/username/.config/bellini/' \n";
 
@@ -160,13 +181,24 @@ All options are specified in config file, see in '/home/username/.config/bellini
 
     // general: handle command-line arguments
     int c;
+    bool plan_only = false;
     char configPath[PATH_MAX];
     configPath[0] = '\0';
-    while ((c = getopt(argc, argv, "p:vh")) != -1) {
+    static struct option long_options[] = {
+        {"plan-only", no_argument, NULL, 'P'},
+        {NULL, 0, NULL, 0}
+    };
+    while ((c = getopt_long(argc, argv, "p:bvh", long_options, NULL)) != -1) {
         switch (c) {
+        case 'P': // argument: only generate wisdom
+            plan_only = true;
+            break;
         case 'p': // argument: fifo path
             snprintf(configPath, sizeof(configPath), "%s", optarg);
             break;
+        case 'b': // argument: benchmark the analysis chain
+            bench_fft();
+            return EXIT_SUCCESS;
         case 'h': // argument: print usage
             printf("%s", usage);
             return EXIT_FAILURE;
@@ -190,6 +222,14 @@ All options are specified in config file, see in '/home/username/.config/bellini
         exit(EXIT_FAILURE);
     }
 
+    // fft: planner and wisdom cache
+    fft_set_planner(p.planner);
+    fft_set_threads(p.threads);
+    fft_wisdom_load();
+    if (plan_only) {
+        return fft_plan_only(&p);
+    }
+
     // config: plot colours
     // TODO: use parse_color
     uint32_t r, g, b, a=0;
@@ -218,7 +258,20 @@ All options are specified in config file, see in '/home/username/.config/bellini
     /*** set up audio processing ***/
 
     struct audio_data audio;
-    audio_init(&audio, p.audio_source);
+    audio_init(&audio, p.audio_source, DEFAULT_FFT_SIZE);
+
+    // octave bands, filtered on the capture thread while vis = oct,
+    // time weighted slow if the spectrum is, otherwise fast
+    struct octave octave;
+    octave_init(&octave, p.octave_fraction, strcmp(p.averaging, "slow") ? AVERAGE_FAST : AVERAGE_SLOW);
+    audio.octave = &octave;
+
+    /*** set up spectral analysis ***/
+
+    // one display bin per two pixels
+    struct analysis analysis;
+    analysis_init(&analysis, &audio, &p, ax_l.screen_w / 2);
+    fft_wisdom_save();
 
     /*** set up audio input ***/
 
@@ -308,6 +361,9 @@ All options are specified in config file, see in '/home/username/.config/bellini
         exit(EXIT_FAILURE); // Can't happen.
     }
 
+    debug("starting analysis thread\n");
+    analysis_start(&analysis);
+
     /*** main loop ***/
 
     // loop-scope variables
@@ -319,10 +375,12 @@ All options are specified in config file, see in '/home/username/.config/bellini
 
         // if config file is modified, reloads every 5s
         if ((now % 5) == 0) {
-            check_config_changed(configPath,
+            if (check_config_changed(configPath,
                     &plot_l_c, &plot_r_c,
                     &ax_c, &ax2_c,
-                    &text_c, &audio_c, &osc_c);
+                    &text_c, &audio_c, &osc_c)) {
+                analysis_weighting(&analysis, &p);
+            }
         }
 
 #ifdef NDEBUG
@@ -335,8 +393,23 @@ All options are specified in config file, see in '/home/username/.config/bellini
                         case SDLK_q:
                             clean_exit = true;
                             break;
+                        // pan and zoom the band of transform = zoom
+                        case SDLK_LEFT:
+                            analysis_zoom(&analysis, -0.25, 1);
+                            break;
+                        case SDLK_RIGHT:
+                            analysis_zoom(&analysis, 0.25, 1);
+                            break;
+                        case SDLK_UP:
+                            analysis_zoom(&analysis, 0, 0.5);
+                            break;
+                        case SDLK_DOWN:
+                            analysis_zoom(&analysis, 0, 2);
+                            break;
                         case SDLK_v:
                             if (!strcmp("fft", p.vis)) {
+                                p.vis = "oct";
+                            } else if (!strcmp("oct", p.vis)) {
                                 p.vis = "ppm";
                             } else if (!strcmp("ppm", p.vis)) {
                                 p.vis = "pcm";
@@ -354,6 +427,8 @@ All options are specified in config file, see in '/home/username/.config/bellini
                     break;
                 case SDL_MOUSEBUTTONDOWN:
                     if (!strcmp("fft", p.vis)) {
+                        p.vis = "oct";
+                    } else if (!strcmp("oct", p.vis)) {
                         p.vis = "ppm";
                     } else if (!strcmp("ppm", p.vis)) {
                         p.vis = "pcm";
@@ -367,25 +442,38 @@ All options are specified in config file, see in '/home/username/.config/bellini
                         p.vis = "fft";
                     }
                     break;
+                case SDL_WINDOWEVENT:
+                    // exposed, resized and so on
+                    sdl_stale();
+                    break;
+                case SDL_RENDER_TARGETS_RESET:
+                case SDL_RENDER_DEVICE_RESET:
+                    // the layers' textures have lost their contents
+                    sdl_reset();
+                    break;
                 case SDL_QUIT:
                     clean_exit = true;
                     break;
             }
         }
 
+        __atomic_store_n(&octave.active, !strcmp("oct", p.vis), __ATOMIC_RELAXED);
+
         vis_blit();
         if (!audio.running) {
             vis_clock(p.width, text_c);
         } else if (!strcmp("fft", p.vis)) {
-            vis_fft(&audio, audio.p_l, audio.p_r, &p, ax_l, ax_r, ax_c, ax2_c, plot_l_c, plot_r_c);
+            vis_fft(&analysis, &p, ax_l, ax_r, ax_c, ax2_c, plot_l_c, plot_r_c);
+        } else if (!strcmp("oct", p.vis)) {
+            vis_oct(&octave, &p, ax_l, ax_r, ax_c, ax2_c, plot_l_c, plot_r_c);
         } else if (!strcmp("pcm", p.vis)) {
             vis_pcm(&audio, &ax_l, &ax_r, plot_l_c, plot_r_c);
         } else if (!strcmp("osc", p.vis)) {
-            vis_osc(&audio, &ax_l, &ax_r, osc_c);
+            vis_osc(&audio, &p, &ax_l, &ax_r, osc_c);
         } else if (!strcmp("pol", p.vis)) {
-            vis_polar(&audio, &ax_l, &ax_r, plot_l_c, plot_r_c);
+            vis_polar(&audio, &p, &ax_l, &ax_r, plot_l_c, plot_r_c);
         } else if (!strcmp("jul", p.vis)) {
-            vis_julia(&audio, osc_c);
+            vis_julia(&audio, &p, osc_c);
         } else {
             vis_ppm(&audio, p.width, ax_l, audio_c, ax_c, ax2_c, plot_l_c, plot_r_c);
         }
@@ -406,6 +494,8 @@ All options are specified in config file, see in '/home/username/.config/bellini
     audio.terminate = 1;
     pthread_join(p_thread, NULL);
 
+    analysis_cleanup(&analysis);
+    octave_free(&octave);
     vis_cleanup();
     audio_cleanup(&audio, sourceIsAuto);
 
@@ -1,5 +1,12 @@
 #include "config.h"
 #include "util.h"
+#include "sigproc.h"
+#include "analysis/sdft.h"
+#include "analysis/average.h"
+#include "analysis/peaks.h"
+#include "analysis/weighting.h"
+#include "output/julia.h"
+#include "output/pixel.h"
 
 #include <ctype.h>
 #include <iniparser.h>
@@ -95,6 +102,108 @@ bool validate_config(struct config_params *p, struct error_s *error) {
         return false;
     }
 
+    // validate: planner
+    if (strcmp(p->planner, "estimate") && strcmp(p->planner, "measure") &&
+            strcmp(p->planner, "patient") && strcmp(p->planner, "exhaustive")) {
+        write_errorf(error, "planner '%s' is not supported, supported planners are: "
+                            "'estimate' 'measure' 'patient' 'exhaustive'\n", p->planner);
+        return false;
+    }
+
+    // validate: analysis
+    if (strcmp(p->transform, "fft") && strcmp(p->transform, "sdft") &&
+            strcmp(p->transform, "multirate") && strcmp(p->transform, "cqt") &&
+            strcmp(p->transform, "zoom") && strcmp(p->transform, "reassigned")) {
+        write_errorf(error, "transform '%s' is not supported, supported transforms are: "
+                            "'fft' 'sdft' 'multirate' 'cqt' 'zoom' 'reassigned'\n", p->transform);
+        return false;
+    }
+    enum averaging averaging;
+    if (!average_mode(p->averaging, &averaging)) {
+        write_errorf(error, "averaging '%s' is not supported, supported averaging is: "
+                            "'none' 'fast' 'slow' 'impulse' 'linear' 'max' 'min'\n", p->averaging);
+        return false;
+    }
+    enum weighting_curve curve;
+    if (!weighting_curve(p->weighting, &curve)) {
+        write_errorf(error, "weighting '%s' is not supported, supported weightings are: "
+                            "'a' 'c' 'z'\n", p->weighting);
+        return false;
+    }
+    for (int n = 0; n < p->userEQ_keys; n++) {
+        if (p->userEQ[n] < 0) {
+            write_errorf(error, "eq values must not be negative\n");
+            return false;
+        }
+    }
+    if (p->average_frames < 1) {
+        p->average_frames = 1;
+    }
+    if (p->hold_decay < 0) {
+        p->hold_decay = 0;
+    }
+    if (p->fft_size < 64 || p->fft_size > MAX_FFT_SIZE) {
+        write_errorf(error, "fft_size must be between 64 and %d\n", MAX_FFT_SIZE);
+        return false;
+    }
+    if (!strcmp(p->transform, "sdft") && p->fft_size > SDFT_SIZE_MAX) {
+        write_errorf(error, "fft_size must be at most %d with transform = sdft\n", SDFT_SIZE_MAX);
+        return false;
+    }
+    if (p->bins_per_octave < 1 || p->bins_per_octave > 96) {
+        write_errorf(error, "bins_per_octave must be between 1 and 96\n");
+        return false;
+    }
+    if (p->octave_fraction != 1 && p->octave_fraction != 3 &&
+            p->octave_fraction != 6 && p->octave_fraction != 12) {
+        write_errorf(error, "octave_fraction must be 1, 3, 6 or 12\n");
+        return false;
+    }
+    if (p->zoom_low <= 0 || p->zoom_high <= p->zoom_low) {
+        write_errorf(error, "zoom_low must be above 0 and below zoom_high\n");
+        return false;
+    }
+    if (p->threads < 0) {
+        p->threads = 0;
+    }
+    if (p->overlap < 0) {
+        p->overlap = 0;
+    } else if (p->overlap > 0.99) {
+        p->overlap = 0.99;
+    }
+
+    // validate: peak labels
+    if (p->peak_labels < 0) {
+        p->peak_labels = 0;
+    } else if (p->peak_labels > PEAKS_MAX) {
+        p->peak_labels = PEAKS_MAX;
+    }
+
+    // validate: blur
+    if (p->blur_radius < 0) {
+        p->blur_radius = 0;
+    } else if (p->blur_radius > PX_BLUR_RADIUS_MAX) {
+        p->blur_radius = PX_BLUR_RADIUS_MAX;
+    }
+    if (p->blur_passes < 1) {
+        p->blur_passes = 1;
+    } else if (p->blur_passes > 3) {
+        p->blur_passes = 3;
+    }
+    if (p->render_threads < 0) {
+        p->render_threads = 0;
+    }
+
+    // validate: julia
+    if (p->julia_quality < 0) {
+        p->julia_quality = 0;
+    } else if (p->julia_quality > JULIA_QUALITY_MAX) {
+        p->julia_quality = JULIA_QUALITY_MAX;
+    }
+    if (p->julia_frame_ms < 0) {
+        p->julia_frame_ms = 0;
+    }
+
     // validate: persistence
     if (p->persistence < 0) {
         p->persistence = 0;
@@ -189,12 +298,23 @@ bool load_config(char configPath[PATH_MAX], struct config_params *p, struct erro
     }
 
     p->noise_floor = iniparser_getint(ini, "general:noise_floor", -100);
+    p->floor_trace = !strcmp(iniparser_getstring(ini, "general:floor_trace", "false"), "true");
+    p->floor_gate = !strcmp(iniparser_getstring(ini, "general:floor_gate", "false"), "true");
+    p->peak_labels = iniparser_getint(ini, "general:peak_labels", 0);
+    p->auto_range = !strcmp(iniparser_getstring(ini, "general:auto_range", "true"), "true");
+    p->blur_radius = iniparser_getint(ini, "general:blur_radius", 1);
+    p->blur_passes = iniparser_getint(ini, "general:blur_passes", 1);
+    p->julia_quality = iniparser_getint(ini, "general:julia_quality", 2);
+    p->julia_frame_ms = iniparser_getdouble(ini, "general:julia_frame_ms", 10);
 
     p->height = iniparser_getint(ini, "output:height", 480);
     p->width = iniparser_getint(ini, "output:width", 800);
     p->rotate = iniparser_getint(ini, "output:rotate", 0);
+    p->render_threads = iniparser_getint(ini, "output:render_threads", 0);
 
     p->fullscreen = !strcmp(iniparser_getstring(ini, "output:fullscreen", "false"), "true");
+    p->gpu_persistence = !strcmp(iniparser_getstring(ini, "output:gpu_persistence", "false"), "true");
+    p->streaming = !strcmp(iniparser_getstring(ini, "output:streaming", "false"), "true");
     
     free(p->text_font);
     p->text_font = strdup(iniparser_getstring(ini, "general:text_font", "/usr/share/fonts/truetype/dejavu/DejaVuSerif.ttf"));
@@ -205,6 +325,40 @@ bool load_config(char configPath[PATH_MAX], struct config_params *p, struct erro
     free(p->vis);
     p->vis = strdup(iniparser_getstring(ini, "general:vis", "fft"));
 
+    // config: analysis
+    free(p->planner);
+    p->planner = strdup(iniparser_getstring(ini, "analysis:planner", "measure"));
+    free(p->transform);
+    p->transform = strdup(iniparser_getstring(ini, "analysis:transform", "fft"));
+    free(p->averaging);
+    p->averaging = strdup(iniparser_getstring(ini, "analysis:averaging", "fast"));
+    free(p->weighting);
+    p->weighting = strdup(iniparser_getstring(ini, "analysis:weighting", "z"));
+    p->average_frames = iniparser_getint(ini, "analysis:average_frames", 8);
+    p->hold_decay = iniparser_getdouble(ini, "analysis:hold_decay", 20);
+    p->fft_size = iniparser_getint(ini, "analysis:fft_size", 8192);
+    p->overlap = iniparser_getdouble(ini, "analysis:overlap", 0.75);
+    p->threads = iniparser_getint(ini, "analysis:threads", 0);
+    p->bins_per_octave = iniparser_getint(ini, "analysis:bins_per_octave", 48);
+    p->octave_fraction = iniparser_getint(ini, "analysis:octave_fraction", 3);
+    p->zoom_low = iniparser_getdouble(ini, "analysis:zoom_low", 45);
+    p->zoom_high = iniparser_getdouble(ini, "analysis:zoom_high", 55);
+
+    // config: user EQ, one multiplier per key in order, spread over the frequency range
+    free(p->userEQ);
+    p->userEQ = NULL;
+    p->userEQ_keys = iniparser_getsecnkeys(ini, "eq");
+    if (p->userEQ_keys > 0) {
+        const char *keys[p->userEQ_keys];
+        p->userEQ = calloc(p->userEQ_keys, sizeof(double));
+        iniparser_getseckeys(ini, "eq", keys);
+        for (int n = 0; n < p->userEQ_keys; n++) {
+            p->userEQ[n] = iniparser_getdouble(ini, keys[n], 1);
+        }
+    } else {
+        p->userEQ_keys = 0;
+    }
+
     // config: output
     free(p->audio_source);
 
@@ -38,12 +38,15 @@ enum input_method {
 
 struct config_params {
     char *plot_l_col, *plot_r_col, *ax_col, *ax_2_col, *text_col, *audio_col, *osc_col;
-    char *audio_source, *text_font, *audio_font, *vis;
-    double persistence, noise_floor;
-    double *userEQ;
+    char *audio_source, *text_font, *audio_font, *vis, *planner, *transform, *averaging, *weighting;
+    double persistence, noise_floor, overlap, zoom_low, zoom_high, hold_decay, julia_frame_ms;
+    double *userEQ;     // [eq] amplitude multipliers, low to high frequency
+    int userEQ_keys;
     enum input_method im;
-    bool fullscreen;
-    int col, bgcol, fifoSample, fifoSampleBits, height, width, rotate;
+    bool fullscreen, floor_trace, floor_gate, auto_range, gpu_persistence, streaming;
+    int col, bgcol, fifoSample, fifoSampleBits, height, width, rotate, fft_size, threads, bins_per_octave, average_frames, octave_fraction;
+    int peak_labels;
+    int blur_radius, blur_passes, render_threads, julia_quality;
 };
 
 struct error_s {
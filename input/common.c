@@ -1,10 +1,11 @@
 #include "input/common.h"
+#include "analysis/octave.h"
 #include "debug.h"
 
 #include <string.h>
 
 
-void audio_init(struct audio_data *audio, char *audio_source) {
+void audio_init(struct audio_data *audio, char *audio_source, int buffer_size) {
     memset(audio, 0, sizeof(*audio));
 
     // input: init
@@ -13,28 +14,18 @@ void audio_init(struct audio_data *audio, char *audio_source) {
 
     audio->format = -1;
     audio->rate = 0;
-    audio->FFTbufferSize = 8192;
+    audio->FFTbufferSize = buffer_size;
     audio->terminate = 0;
     audio->channels = 2;
     audio->index = 0;
+    audio->samples = 0;
     audio->running = 1;
 
-    // allocate fft memory
-    audio->in_r = fftw_alloc_real(2 * (audio->FFTbufferSize / 2 + 1));
-    audio->in_l = fftw_alloc_real(2 * (audio->FFTbufferSize / 2 + 1));
-    memset(audio->in_r, 0, 2 * (audio->FFTbufferSize / 2 + 1) * sizeof(double));
-    memset(audio->in_l, 0, 2 * (audio->FFTbufferSize / 2 + 1) * sizeof(double));
-
-    audio->windowed_r = fftw_alloc_real(2 * (audio->FFTbufferSize / 2 + 1));
-    audio->windowed_l = fftw_alloc_real(2 * (audio->FFTbufferSize / 2 + 1));
-
-    audio->out_l = fftw_alloc_complex(2 * (audio->FFTbufferSize / 2 + 1));
-    audio->out_r = fftw_alloc_complex(2 * (audio->FFTbufferSize / 2 + 1));
-    memset(audio->out_l, 0, 2 * (audio->FFTbufferSize / 2 + 1) * sizeof(fftw_complex));
-    memset(audio->out_r, 0, 2 * (audio->FFTbufferSize / 2 + 1) * sizeof(fftw_complex));
-
-    audio->p_l = fftw_plan_dft_r2c_1d(audio->FFTbufferSize, audio->windowed_l, audio->out_l, FFTW_MEASURE);
-    audio->p_r = fftw_plan_dft_r2c_1d(audio->FFTbufferSize, audio->windowed_r, audio->out_r, FFTW_MEASURE);
+    // allocate capture memory
+    audio->in_r = FFTW(alloc_real)(2 * (audio->FFTbufferSize / 2 + 1));
+    audio->in_l = FFTW(alloc_real)(2 * (audio->FFTbufferSize / 2 + 1));
+    memset(audio->in_r, 0, 2 * (audio->FFTbufferSize / 2 + 1) * sizeof(sample_t));
+    memset(audio->in_l, 0, 2 * (audio->FFTbufferSize / 2 + 1) * sizeof(sample_t));
 
     debug("got buffer size: %d", audio->FFTbufferSize);
 
@@ -47,21 +38,14 @@ void audio_cleanup(struct audio_data *audio, int sourceIsAuto) {
     if (sourceIsAuto)
         free(audio->source);
 
-    // free fft working space
-    fftw_free(audio->in_r);
-    fftw_free(audio->in_l);
-    fftw_free(audio->windowed_r);
-    fftw_free(audio->windowed_l);
-    fftw_free(audio->out_r);
-    fftw_free(audio->out_l);
-    fftw_destroy_plan(audio->p_l);
-    fftw_destroy_plan(audio->p_r);
-    fftw_cleanup();
+    // free capture memory
+    FFTW(free)(audio->in_r);
+    FFTW(free)(audio->in_l);
 }
 
 void reset_output_buffers(struct audio_data *audio) {
-    memset(audio->in_r, 0, sizeof(double) * 2 * (audio->FFTbufferSize / 2 + 1));
-    memset(audio->in_l, 0, sizeof(double) * 2 * (audio->FFTbufferSize / 2 + 1));
+    memset(audio->in_r, 0, sizeof(sample_t) * 2 * (audio->FFTbufferSize / 2 + 1));
+    memset(audio->in_l, 0, sizeof(sample_t) * 2 * (audio->FFTbufferSize / 2 + 1));
 }
 
 int write_to_fftw_input_buffers(int16_t buf[], int16_t frames, struct audio_data *audio) {
@@ -72,9 +56,22 @@ int write_to_fftw_input_buffers(int16_t buf[], int16_t frames, struct audio_data
         audio->in_r[audio->index] = buf[i + 1];
 
         audio->index++;
-        if (audio->index == audio->FFTbufferSize - 1)
+        if (audio->index == audio->FFTbufferSize)
             audio->index = 0;
     }
 
+    // octave bands are filtered per sample, so they run here rather than per frame
+    if (audio->octave) {
+        octave_push(audio->octave, buf, frames, audio->rate);
+    }
+
+    // publish the new frames to the analysis thread
+    __atomic_store_n(&audio->samples, audio->samples + frames, __ATOMIC_RELEASE);
+
     return 0;
 }
+
+// frames captured so far; the ring holds the last FFTbufferSize of them
+unsigned long long audio_samples(struct audio_data *audio) {
+    return __atomic_load_n(&audio->samples, __ATOMIC_ACQUIRE);
+}
@@ -12,12 +12,27 @@
 #include <unistd.h>
 #include <fftw3.h>
 
+#include "util.h"
+
+// FFTW API matching sample_t, e.g. FFTW(execute) is fftw_execute or fftwf_execute.
+#ifdef SINGLE_PRECISION
+#define FFTW(name) fftwf_##name
+typedef fftwf_complex fft_complex;
+typedef fftwf_plan fft_plan;
+#else
+#define FFTW(name) fftw_##name
+typedef fftw_complex fft_complex;
+typedef fftw_plan fft_plan;
+#endif
+
+struct octave;
+
+// capture ring buffer, shared between the input and analysis threads
 struct audio_data {
     int FFTbufferSize;
-    int index;
-    double *in_r, *in_l, *windowed_l, *windowed_r;
-    fftw_complex *out_l, *out_r;
-    fftw_plan p_l, p_r;
+    int index;          // next write position, always samples % FFTbufferSize
+    unsigned long long samples; // frames captured since start
+    sample_t *in_r, *in_l;
     int format;
     unsigned int rate;
     char *source;   // alsa device, fifo path or pulse source
@@ -26,12 +41,15 @@ struct audio_data {
     int terminate;  // shared variable used to terminate audio thread
     int running;    // for shmem input
     char error_message[1024];
+    struct octave *octave;  // band filters run on the capture thread, if set
 };
 
-void audio_init(struct audio_data *audio, char *audio_source);
+void audio_init(struct audio_data *audio, char *audio_source, int buffer_size);
 
 void audio_cleanup(struct audio_data *audio, int sourceIsAuto);
 
 void reset_output_buffers(struct audio_data *audio);
 
 int write_to_fftw_input_buffers(int16_t buf[], int16_t frames, struct audio_data *audio);
+
+unsigned long long audio_samples(struct audio_data *audio);
@@ -5,6 +5,7 @@
 #include "input/shmem.h"
 #include "input/common.h"
 #include "debug.h"
+#include "util.h"
 
 typedef unsigned int u32_t;
 typedef short s16_t;
@@ -29,11 +30,10 @@ void *input_shmem(void *data) {
     int fd; /* file descriptor to mmaped area */
     int mmap_count = sizeof(vis_t);
     int buf_frames;
-    // Reread multiple times each buffer replacement (overlapping windows).
-    // Too slow and the fft buffer will miss sometimes because there is no
-    // sync between this thread and the other.
-    // This loop can go very fast indeed with minimal performance impact
-    // and the benefit is fresh data for the high frequencies and no flicker.
+    // squeezelite's write position when we last looked, in samples (-1 before the first read)
+    int last_index = -1;
+    // Poll often, but only copy the frames squeezelite has added since the last poll,
+    // so the capture sample count follows audio time and nothing is written twice.
     struct timespec req = {.tv_sec = 0, .tv_nsec = 1e9 / 3000};
     // 0.1s long sleep when not playing to lower CPU usage
     struct timespec req_silence = {.tv_sec = 0, .tv_nsec = 1e8};
@@ -61,12 +61,20 @@ void *input_shmem(void *data) {
         audio->rate = mmap_area->rate;
         audio->running = mmap_area->running;
         buf_frames = mmap_area->buf_size / 2;       // there are two channels
-        audio->index = (audio->FFTbufferSize - mmap_area->buf_index / 2) % audio->FFTbufferSize;
-        if (mmap_area->running) {
-            write_to_fftw_input_buffers(mmap_area->buffer, buf_frames, audio);
+        if (mmap_area->running && mmap_area->buf_size) {
+            // squeezelite's buffer is a ring too; copy oldest first, unwrapping at the end
+            int buf_index = mmap_area->buf_index % mmap_area->buf_size;
+            int new_frames = last_index < 0 ? buf_frames
+                : ((buf_index - last_index + (int)mmap_area->buf_size) % (int)mmap_area->buf_size) / 2;
+            int start = (buf_index / 2 - new_frames + buf_frames) % buf_frames;
+            int first = min(new_frames, buf_frames - start);
+            write_to_fftw_input_buffers(mmap_area->buffer + 2 * start, first, audio);
+            write_to_fftw_input_buffers(mmap_area->buffer, new_frames - first, audio);
+            last_index = buf_index;
             nanosleep(&req, NULL);
         } else {
             write_to_fftw_input_buffers(silence_buffer, buf_frames, audio);
+            last_index = -1;
             nanosleep(&req_silence, NULL);
         }
     }
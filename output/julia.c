@@ -0,0 +1,339 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "output/julia.h"
+
+#include "debug.h"
+#include "util.h"
+
+// the widest float vectors the compiler targets; PIXEL_SCALAR (--disable-simd) forces the reference
+#if defined(PIXEL_SCALAR)
+#elif defined(__AVX2__)
+#define JL_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#define JL_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define JL_NEON
+#include <arm_neon.h>
+#endif
+
+// by quality, the largest blocks filled when their corners agree
+static const int julia_guess[JULIA_QUALITY_MAX + 1] = {8, 4, 2, 0};
+// and the frames a stable coarse block keeps its counts before being iterated afresh
+static const int julia_reuse[JULIA_QUALITY_MAX + 1] = {15, 7, 3, 0};
+
+// iterations of the point (x, y) before it escapes
+static inline int julia_point(float x, float y, float cx, float cy, float r2) {
+    int k = 0;
+    for (; k < JULIA_ITERATIONS; k++) {
+        float x2 = x * x;
+        float y2 = y * y;
+        if (!(x2 + y2 < r2))
+            break;
+        y = (x + x) * y + cy;
+        x = (x2 - y2) + cx;
+    }
+    return k;
+}
+
+void julia_points_ref(int *count, int n, const float *zx, float zy, float cx, float cy, float r2) {
+    for (int i = 0; i < n; i++) {
+        count[i] = julia_point(zx[i], zy, cx, cy, r2);
+    }
+}
+
+/*
+ * Each lane's count goes up by its mask (-1 while inside) being subtracted. Lanes that
+ * have escaped carry on iterating uselessly, but |z| only grows outside the escape radius,
+ * and overflow goes to inf or nan, which compare false, so they never count again.
+ */
+
+#if defined(JL_AVX2)
+
+#define JL_LANES 8
+
+static inline void julia_vec(int *count, const float *zx, float zy, float cx, float cy, float r2) {
+    __m256 x = _mm256_loadu_ps(zx);
+    __m256 y = _mm256_set1_ps(zy);
+    const __m256 vcx = _mm256_set1_ps(cx), vcy = _mm256_set1_ps(cy), vr2 = _mm256_set1_ps(r2);
+    __m256i k = _mm256_setzero_si256();
+    for (int n = 0; n < JULIA_ITERATIONS; n++) {
+        __m256 x2 = _mm256_mul_ps(x, x);
+        __m256 y2 = _mm256_mul_ps(y, y);
+        __m256 inside = _mm256_cmp_ps(_mm256_add_ps(x2, y2), vr2, _CMP_LT_OQ);
+        if (!_mm256_movemask_ps(inside))
+            break;
+        k = _mm256_sub_epi32(k, _mm256_castps_si256(inside));
+        y = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(x, x), y), vcy);
+        x = _mm256_add_ps(_mm256_sub_ps(x2, y2), vcx);
+    }
+    _mm256_storeu_si256((__m256i *)count, k);
+}
+
+#elif defined(JL_SSE2)
+
+#define JL_LANES 4
+
+static inline void julia_vec(int *count, const float *zx, float zy, float cx, float cy, float r2) {
+    __m128 x = _mm_loadu_ps(zx);
+    __m128 y = _mm_set1_ps(zy);
+    const __m128 vcx = _mm_set1_ps(cx), vcy = _mm_set1_ps(cy), vr2 = _mm_set1_ps(r2);
+    __m128i k = _mm_setzero_si128();
+    for (int n = 0; n < JULIA_ITERATIONS; n++) {
+        __m128 x2 = _mm_mul_ps(x, x);
+        __m128 y2 = _mm_mul_ps(y, y);
+        __m128 inside = _mm_cmplt_ps(_mm_add_ps(x2, y2), vr2);
+        if (!_mm_movemask_ps(inside))
+            break;
+        k = _mm_sub_epi32(k, _mm_castps_si128(inside));
+        y = _mm_add_ps(_mm_mul_ps(_mm_add_ps(x, x), y), vcy);
+        x = _mm_add_ps(_mm_sub_ps(x2, y2), vcx);
+    }
+    _mm_storeu_si128((__m128i *)count, k);
+}
+
+#elif defined(JL_NEON)
+
+#define JL_LANES 4
+
+static inline int julia_any(uint32x4_t m) {
+#if defined(__aarch64__)
+    return vmaxvq_u32(m) != 0;
+#else
+    uint32x2_t h = vorr_u32(vget_low_u32(m), vget_high_u32(m));
+    return (vget_lane_u32(h, 0) | vget_lane_u32(h, 1)) != 0;
+#endif
+}
+
+static inline void julia_vec(int *count, const float *zx, float zy, float cx, float cy, float r2) {
+    float32x4_t x = vld1q_f32(zx);
+    float32x4_t y = vdupq_n_f32(zy);
+    const float32x4_t vcx = vdupq_n_f32(cx), vcy = vdupq_n_f32(cy), vr2 = vdupq_n_f32(r2);
+    uint32x4_t k = vdupq_n_u32(0);
+    for (int n = 0; n < JULIA_ITERATIONS; n++) {
+        // separate multiply and add, as the reference does, rather than fused
+        float32x4_t x2 = vmulq_f32(x, x);
+        float32x4_t y2 = vmulq_f32(y, y);
+        uint32x4_t inside = vcltq_f32(vaddq_f32(x2, y2), vr2);
+        if (!julia_any(inside))
+            break;
+        k = vsubq_u32(k, inside);
+        y = vaddq_f32(vmulq_f32(vaddq_f32(x, x), y), vcy);
+        x = vaddq_f32(vsubq_f32(x2, y2), vcx);
+    }
+    vst1q_s32(count, vreinterpretq_s32_u32(k));
+}
+
+#endif
+
+void julia_points(int *count, int n, const float *zx, float zy, float cx, float cy, float r2) {
+    int i = 0;
+#ifdef JL_LANES
+    for (; i + JL_LANES <= n; i += JL_LANES) {
+        julia_vec(count + i, zx + i, zy, cx, cy, r2);
+    }
+#endif
+    julia_points_ref(count + i, n - i, zx + i, zy, cx, cy, r2);
+}
+
+/*
+ * progressive rendering
+ */
+
+void julia_init(struct julia *j, int w, int h) {
+    memset(j, 0, sizeof(*j));
+    j->w = w;
+    j->h = h;
+    j->x0 = w / 2;
+    j->y0 = h / 2;
+    // rows down to z = 0, and columns out to the one that reflects onto column 0
+    int columns = max(w, 2 * j->x0 + 1);
+    int rows = j->y0 + 1;
+    j->blocks_x = (columns + JULIA_BLOCK - 1) / JULIA_BLOCK;
+    int blocks_y = (rows + JULIA_BLOCK - 1) / JULIA_BLOCK;
+    j->pw = j->blocks_x * JULIA_BLOCK + 1;
+    j->ph = blocks_y * JULIA_BLOCK + 1;
+    j->tiles_x = (j->pw - 1 + JULIA_TILE - 1) / JULIA_TILE;
+    j->tiles_y = (j->ph - 1 + JULIA_TILE - 1) / JULIA_TILE;
+    size_t points = (size_t)j->pw * j->ph;
+    j->count = calloc(points, sizeof(int16_t));
+    j->last = calloc(points, sizeof(int16_t));
+    j->open = calloc(points, sizeof(uint8_t));
+    j->exact = calloc((size_t)j->blocks_x * blocks_y, sizeof(uint8_t));
+    debug("julia: %dx%d points for %dx%d pixels\n", j->pw, j->ph, w, h);
+}
+
+// the points of tile t, x from *x_first to *x_last - 1 and the same in y; the last tiles
+// take the far corners of the grid
+static void julia_tile(const struct julia *j, int t, int *x_first, int *x_last, int *y_first, int *y_last) {
+    int tx = t % j->tiles_x;
+    int ty = t / j->tiles_x;
+    *x_first = tx * JULIA_TILE;
+    *y_first = ty * JULIA_TILE;
+    *x_last = tx == j->tiles_x - 1 ? j->pw : *x_first + JULIA_TILE;
+    *y_last = ty == j->tiles_y - 1 ? j->ph : *y_first + JULIA_TILE;
+}
+
+// iterate the points of the grid step apart that are new corners of open blocks: those
+// with an open block above or below, to the left or right; all open blocks are of size step
+static void julia_compute(void *arg, int t) {
+    struct julia *j = arg;
+    const int s = j->step;
+    int x_first, x_last, y_first, y_last;
+    julia_tile(j, t, &x_first, &x_last, &y_first, &y_last);
+    float zx[JULIA_TILE + 1];
+    int xs[JULIA_TILE + 1];
+    int count[JULIA_TILE + 1];
+    // open blocks in either row, from x_first - s
+    uint8_t any[JULIA_TILE + 1 + JULIA_BLOCK];
+    for (int y = y_first; y < y_last; y += s) {
+        // the corners of the blocks just split are known
+        bool coarse = !j->initial && y % (2 * s) == 0;
+        int n = 0;
+        if (j->initial) {
+            for (int x = x_first; x < x_last; x += s) {
+                xs[n] = x;
+                zx[n++] = j->scale * (float)(x - j->x0);
+            }
+        } else {
+            const uint8_t *up = j->open + (size_t)max(0, y - s) * j->pw;
+            const uint8_t *down = j->open + (size_t)y * j->pw;
+            int first = max(0, x_first - s);
+            uint8_t open = 0;
+            for (int x = first; x < x_last; x++) {
+                any[x - first] = up[x] | down[x];
+                open |= any[x - first];
+            }
+            if (!open)
+                continue;
+            for (int x = coarse ? x_first + s : x_first; x < x_last; x += coarse ? 2 * s : s) {
+                if (any[x - first] || (x > 0 && any[x - s - first])) {
+                    xs[n] = x;
+                    zx[n++] = j->scale * (float)(x - j->x0);
+                }
+            }
+        }
+        julia_points(count, n, zx, j->scale * (float)(y - j->y0), j->cx, j->cy, j->r2);
+        for (int i = 0; i < n; i++) {
+            j->count[y * j->pw + xs[i]] = (int16_t)count[i];
+        }
+    }
+}
+
+// the block of size s at (x, y) filled with count k, or copied from the last frame if
+// from is set; the top left corner, which neighbouring jobs may be reading, is left as it is
+static void julia_fill(struct julia *j, int x, int y, int s, int16_t k, bool from) {
+    for (int dy = 0; dy < s; dy++) {
+        size_t i = (size_t)(y + dy) * j->pw + x;
+        for (int dx = dy ? 0 : 1; dx < s; dx++) {
+            j->count[i + dx] = from ? j->last[i + dx] : k;
+        }
+    }
+}
+
+// settle each open block of size step: keep it from the last frame, fill it, or split it
+static void julia_classify(void *arg, int t) {
+    struct julia *j = arg;
+    const int s = j->step;
+    const int h = s / 2;
+    const int pw = j->pw;
+    const int16_t *c = j->count;
+    const int16_t *l = j->last;
+    int x_first, x_last, y_first, y_last;
+    julia_tile(j, t, &x_first, &x_last, &y_first, &y_last);
+    for (int y = y_first; y < min(y_last, j->ph - 1); y += s) {
+        for (int x = x_first; x < min(x_last, pw - 1); x += s) {
+            int i = y * pw + x;
+            if (j->open[i] != s)
+                continue;
+            j->open[i] = 0;
+            int b = (y / JULIA_BLOCK) * j->blocks_x + x / JULIA_BLOCK;
+            int16_t k = c[i];
+            bool agree = c[i + s] == k && c[i + s * pw] == k && c[i + s * pw + s] == k;
+            if (s == JULIA_BLOCK) {
+                int reuse = julia_reuse[j->quality];
+                // a block resolved last frame whose corners haven't changed
+                if (j->coherent && j->exact[b] && (j->frame + b) % (reuse + 1) != 0 &&
+                        l[i] == k && l[i + s] == c[i + s] &&
+                        l[i + s * pw] == c[i + s * pw] && l[i + s * pw + s] == c[i + s * pw + s]) {
+                    julia_fill(j, x, y, s, k, true);
+                    continue;
+                }
+                j->exact[b] = 1;
+            }
+            if (j->force) {
+                j->exact[b] = 0;
+                julia_fill(j, x, y, s, k, false);
+            } else if (agree && s <= julia_guess[j->quality]) {
+                julia_fill(j, x, y, s, k, false);
+            } else {
+                j->open[i] = j->open[i + h] = j->open[i + h * pw] = j->open[i + h * pw + h] = h;
+            }
+        }
+    }
+}
+
+// milliseconds since start
+static double julia_elapsed(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void julia_frame(struct julia *j, struct pool *pl, double cx, double cy, double r2, double scale,
+        int quality, double budget_ms) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int16_t *swap = j->last;
+    j->last = j->count;
+    j->count = swap;
+    j->cx = cx;
+    j->cy = cy;
+    j->r2 = r2;
+    j->scale = scale;
+    j->quality = min(max(quality, 0), JULIA_QUALITY_MAX);
+    // away from the boundary of the set, counts hardly move for a small change of c
+    j->coherent = j->primed && fabs(cx - j->last_cx) + fabs(cy - j->last_cy) < 2 * scale;
+    j->last_cx = cx;
+    j->last_cy = cy;
+    j->primed = true;
+    j->frame++;
+    j->force = false;
+
+    // every coarse block is open, and its corners are iterated
+    memset(j->open, 0, (size_t)j->pw * j->ph);
+    for (int y = 0; y < j->ph - 1; y += JULIA_BLOCK) {
+        for (int x = 0; x < j->pw - 1; x += JULIA_BLOCK) {
+            j->open[y * j->pw + x] = JULIA_BLOCK;
+        }
+    }
+    int tiles = j->tiles_x * j->tiles_y;
+    j->step = JULIA_BLOCK;
+    j->initial = true;
+    pool_run(pl, julia_compute, j, tiles);
+    j->initial = false;
+
+    // then finer, while there is time
+    for (int s = JULIA_BLOCK; s > 1; s /= 2) {
+        j->step = s;
+        j->force = budget_ms > 0 && julia_elapsed(&start) > budget_ms;
+        pool_run(pl, julia_classify, j, tiles);
+        if (j->force) {
+            debug("julia: out of time at %d point blocks\n", s);
+            break;
+        }
+        j->step = s / 2;
+        pool_run(pl, julia_compute, j, tiles);
+    }
+}
+
+void julia_free(struct julia *j) {
+    free(j->count);
+    free(j->last);
+    free(j->open);
+    free(j->exact);
+}
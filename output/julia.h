@@ -0,0 +1,64 @@
+// Escape time iteration of Julia sets, z <- z^2 + c, rendered progressively.
+//
+// julia_points() iterates points together in single precision, 8 lanes with AVX2 and 4
+// with SSE2 or NEON, each lane counting only while it is inside the escape radius; a
+// vector stops when all its lanes have escaped. julia_points_ref() is the scalar
+// reference, which gives the same counts and runs the points left over at the end.
+//
+// julia_frame() fills a grid of counts for one half of the image (the other half is its
+// reflection through z = 0) coarse to fine. It iterates every 8th point, then halves
+// the block size where the corners of a block disagree, filling the blocks whose corners
+// agree. When the frame time budget runs out the open blocks are filled from their corner.
+// Coarse blocks whose corners have the same counts as in the last frame, for a parameter
+// that has moved less than a couple of pixels, keep their last counts, being iterated
+// afresh every few frames.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "output/pool.h"
+
+// iterations at most; points still inside after these are in the set
+#define JULIA_ITERATIONS 120
+// points square of the coarsest blocks
+#define JULIA_BLOCK 8
+// points square of a job; a whole number of blocks
+#define JULIA_TILE 32
+// [general] julia_quality, from blocky and mostly reused to every point iterated every frame
+#define JULIA_QUALITY_MAX 3
+
+struct julia {
+    int w, h;                   // the image
+    int x0, y0;                 // pixel at z = 0
+    int pw, ph;                 // the grid of points: the top half padded to whole blocks, plus their far corners
+    int tiles_x, tiles_y;
+    int blocks_x;
+    int16_t *count, *last;      // escape counts of this frame and the last, pw * ph
+    uint8_t *open;              // the size of the unresolved block at each top left point, or 0
+    uint8_t *exact;             // per coarse block, whether its counts were settled in time rather than filled when out of it
+    unsigned long frame;        // counts frames, to stagger the coarse blocks' refreshes
+    bool primed;
+    // this frame
+    float cx, cy, r2, scale;
+    float last_cx, last_cy;
+    int quality;
+    bool coherent;              // the parameter has moved little enough to keep stable blocks
+    // the level in hand
+    int step;
+    bool initial, force;
+};
+
+// iteration counts of the n points (zx[i], zy), escaping at |z|^2 >= r2
+void julia_points(int *count, int n, const float *zx, float zy, float cx, float cy, float r2);
+void julia_points_ref(int *count, int n, const float *zx, float zy, float cx, float cy, float r2);
+
+void julia_init(struct julia *j, int w, int h);
+
+// counts of the image of the Julia set of c with escape radius^2 r2 and pixels scale apart,
+// at quality 0 to JULIA_QUALITY_MAX, aiming to take at most budget_ms (0 for no limit)
+void julia_frame(struct julia *j, struct pool *pl, double cx, double cy, double r2, double scale,
+        int quality, double budget_ms);
+
+void julia_free(struct julia *j);
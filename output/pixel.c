@@ -0,0 +1,521 @@
+#include <math.h>
+#include <string.h>
+
+#include "output/pixel.h"
+
+#include "util.h"
+
+// the widest kernels the compiler targets; PIXEL_SCALAR (--disable-simd) forces the reference
+#if defined(PIXEL_SCALAR)
+#elif defined(__AVX2__)
+#define PX_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#define PX_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PX_NEON
+#include <arm_neon.h>
+#endif
+
+// largest shade factor, just under 128, whose products (255 f >> 8) still pack from signed 16 bits
+#define PX_FACTOR_MAX 0x7fff
+#define PX_ONE 256
+
+
+uint16_t px_factor(double persistence) {
+    return (uint16_t)fmin(PX_FACTOR_MAX, fmax(0, floor(persistence * PX_ONE)));
+}
+
+/*
+ * scalar references
+ */
+
+// each byte of x times f >> 8, plus the bytes of t, saturated
+static inline uint32_t px_scale(uint32_t x, uint32_t f, uint32_t t) {
+    uint32_t y = 0;
+    for (int s = 0; s < 32; s += 8) {
+        uint32_t c = (((x >> s) & 0xff) * f >> 8) + ((t >> s) & 0xff);
+        y |= min(c, 255u) << s;
+    }
+    return y;
+}
+
+void px_shade_ref(uint32_t *p, uint32_t n, uint16_t f) {
+    f = min(f, PX_FACTOR_MAX);
+    for (uint32_t i = 0; i < n; i++) {
+        p[i] = px_scale(p[i], f, 0);
+    }
+}
+
+void px_blend_ref(uint32_t *p, const uint32_t *q, uint32_t n, uint16_t f) {
+    f = min(f, PX_ONE);
+    for (uint32_t i = 0; i < n; i++) {
+        p[i] = px_scale(p[i], f, px_scale(q[i], PX_ONE - f, 0));
+    }
+}
+
+void px_tinge_ref(uint32_t *p, uint32_t n, uint32_t tint, uint16_t f) {
+    f = min(f, PX_ONE);
+    uint32_t t = px_scale(tint, PX_ONE - f, 0);
+    for (uint32_t i = 0; i < n; i++) {
+        p[i] = px_scale(p[i], f, t);
+    }
+}
+
+void px_superpose_ref(uint32_t *p, const uint32_t *q, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        if (q[i]) {
+            p[i] = q[i];
+        }
+    }
+}
+
+void px_convert_ref(uint32_t *p, const uint32_t *q, uint32_t n, enum px_order o) {
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t x = q[i];
+        switch (o) {
+        case PX_ARGB:
+            x = x >> 8 | x << 24;
+            break;
+        case PX_ABGR:
+            x = x >> 24 | (x >> 8 & 0xff00) | (x << 8 & 0xff0000) | x << 24;
+            break;
+        default:
+            break;
+        }
+        p[i] = x;
+    }
+}
+
+void px_cover(uint32_t *p, const uint8_t *cover, uint32_t n, uint32_t colour) {
+    const uint32_t c02 = colour & 0x00ff00ff;
+    const uint32_t c13 = (colour >> 8) & 0x00ff00ff;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t f = cover[i] + (cover[i] >> 7);
+        if (f == PX_ONE) {
+            p[i] = colour;
+        } else if (f) {
+            // the two products of a channel sum to under 2^16, so stay in its half word
+            uint32_t p02 = (c02 * f + (p[i] & 0x00ff00ff) * (PX_ONE - f)) >> 8;
+            uint32_t p13 = c13 * f + ((p[i] >> 8) & 0x00ff00ff) * (PX_ONE - f);
+            p[i] = (p02 & 0x00ff00ff) | (p13 & 0xff00ff00);
+        }
+    }
+}
+
+void px_grayscale_ref(uint32_t *p, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t x = p[i];
+        uint32_t y = (77 * (x >> 24) + 150 * ((x >> 16) & 0xff) + 29 * ((x >> 8) & 0xff)) >> 8;
+        p[i] = y << 24 | y << 16 | y << 8 | (x & 0xff);
+    }
+}
+
+// out = min(255, sum m >> 16), for n bytes
+static void px_sums_out_ref(uint8_t *out, const uint16_t *sum, uint32_t n, uint16_t m) {
+    for (uint32_t j = 0; j < n; j++) {
+        out[j] = (uint8_t)min((uint32_t)sum[j] * m >> 16, 255u);
+    }
+}
+
+// sum += add - sub, for n bytes
+static void px_sums_step_ref(uint16_t *sum, const uint8_t *add, const uint8_t *sub, uint32_t n) {
+    for (uint32_t j = 0; j < n; j++) {
+        sum[j] += add[j] - sub[j];
+    }
+}
+
+/*
+ * vector kernels
+ * Channels widen to 16 bits as c << 8, so a high multiply by an 8.8 factor gives c f >> 8 exactly.
+ */
+
+#if defined(PX_AVX2)
+
+// 8 pixels of x times f, plus the widened bytes t
+static inline __m256i px_scale_avx2(__m256i x, __m256i f, __m256i t) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo = _mm256_adds_epu16(_mm256_mulhi_epu16(_mm256_unpacklo_epi8(zero, x), f), t);
+    __m256i hi = _mm256_adds_epu16(_mm256_mulhi_epu16(_mm256_unpackhi_epi8(zero, x), f), t);
+    return _mm256_packus_epi16(lo, hi);
+}
+
+#define PX_STEP 8
+#define px_vec __m256i
+#define px_load(p) _mm256_loadu_si256((const __m256i *)(p))
+#define px_store(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+#define px_splat16(f) _mm256_set1_epi16((int16_t)(f))
+#define px_widen(t) _mm256_unpacklo_epi8(_mm256_set1_epi32((int)(t)), _mm256_setzero_si256())
+#define px_scale_vec px_scale_avx2
+#define px_add8(x, y) _mm256_adds_epu8(x, y)
+
+static inline px_vec px_superpose_vec(px_vec x, px_vec y) {
+    return _mm256_blendv_epi8(y, x, _mm256_cmpeq_epi32(y, _mm256_setzero_si256()));
+}
+
+static inline px_vec px_argb_vec(px_vec x) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, 8), _mm256_slli_epi32(x, 24));
+}
+
+static inline px_vec px_abgr_vec(px_vec x) {
+    const __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    return _mm256_shuffle_epi8(x, swap);
+}
+
+static inline px_vec px_grayscale_vec(px_vec x) {
+    __m256i rb = _mm256_and_si256(_mm256_srli_epi32(x, 8), _mm256_set1_epi32(0x00ff00ff));
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(x, 16), _mm256_set1_epi32(0xff));
+    __m256i y = _mm256_add_epi32(_mm256_madd_epi16(rb, _mm256_set1_epi32(77 << 16 | 29)),
+            _mm256_madd_epi16(g, _mm256_set1_epi32(150)));
+    y = _mm256_srli_epi32(y, 8);
+    y = _mm256_or_si256(_mm256_slli_epi32(y, 8), _mm256_or_si256(_mm256_slli_epi32(y, 16), _mm256_slli_epi32(y, 24)));
+    return _mm256_or_si256(y, _mm256_and_si256(x, _mm256_set1_epi32(0xff)));
+}
+
+// box sums of 32 bytes to bytes, and the sums stepped on a row
+#define PX_BYTES 32
+
+static inline void px_sums_out_vec(uint8_t *out, const uint16_t *sum, uint16_t m) {
+    __m256i f = _mm256_set1_epi16((int16_t)m);
+    __m256i lo = _mm256_mulhi_epu16(_mm256_loadu_si256((const __m256i *)sum), f);
+    __m256i hi = _mm256_mulhi_epu16(_mm256_loadu_si256((const __m256i *)(sum + 16)), f);
+    // the pack interleaves the 128 bit lanes, so put them back in order
+    _mm256_storeu_si256((__m256i *)out, _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8));
+}
+
+static inline void px_sums_step_vec(uint16_t *sum, const uint8_t *add, const uint8_t *sub) {
+    for (int h = 0; h < 2; h++) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(sum + 16 * h));
+        s = _mm256_add_epi16(s, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(add + 16 * h))));
+        s = _mm256_sub_epi16(s, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(sub + 16 * h))));
+        _mm256_storeu_si256((__m256i *)(sum + 16 * h), s);
+    }
+}
+
+#elif defined(PX_SSE2)
+
+// 4 pixels of x times f, plus the widened bytes t
+static inline __m128i px_scale_sse2(__m128i x, __m128i f, __m128i t) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_adds_epu16(_mm_mulhi_epu16(_mm_unpacklo_epi8(zero, x), f), t);
+    __m128i hi = _mm_adds_epu16(_mm_mulhi_epu16(_mm_unpackhi_epi8(zero, x), f), t);
+    return _mm_packus_epi16(lo, hi);
+}
+
+#define PX_STEP 4
+#define px_vec __m128i
+#define px_load(p) _mm_loadu_si128((const __m128i *)(p))
+#define px_store(p, x) _mm_storeu_si128((__m128i *)(p), x)
+#define px_splat16(f) _mm_set1_epi16((int16_t)(f))
+#define px_widen(t) _mm_unpacklo_epi8(_mm_set1_epi32((int)(t)), _mm_setzero_si128())
+#define px_scale_vec px_scale_sse2
+#define px_add8(x, y) _mm_adds_epu8(x, y)
+
+static inline px_vec px_superpose_vec(px_vec x, px_vec y) {
+    __m128i m = _mm_cmpeq_epi32(y, _mm_setzero_si128());
+    return _mm_or_si128(_mm_and_si128(m, x), _mm_andnot_si128(m, y));
+}
+
+static inline px_vec px_argb_vec(px_vec x) {
+    return _mm_or_si128(_mm_srli_epi32(x, 8), _mm_slli_epi32(x, 24));
+}
+
+static inline px_vec px_abgr_vec(px_vec x) {
+    __m128i ends = _mm_or_si128(_mm_srli_epi32(x, 24), _mm_slli_epi32(x, 24));
+    __m128i mid = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 8), _mm_set1_epi32(0xff00)),
+            _mm_and_si128(_mm_slli_epi32(x, 8), _mm_set1_epi32(0xff0000)));
+    return _mm_or_si128(ends, mid);
+}
+
+static inline px_vec px_grayscale_vec(px_vec x) {
+    __m128i rb = _mm_and_si128(_mm_srli_epi32(x, 8), _mm_set1_epi32(0x00ff00ff));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(x, 16), _mm_set1_epi32(0xff));
+    __m128i y = _mm_add_epi32(_mm_madd_epi16(rb, _mm_set1_epi32(77 << 16 | 29)),
+            _mm_madd_epi16(g, _mm_set1_epi32(150)));
+    y = _mm_srli_epi32(y, 8);
+    y = _mm_or_si128(_mm_slli_epi32(y, 8), _mm_or_si128(_mm_slli_epi32(y, 16), _mm_slli_epi32(y, 24)));
+    return _mm_or_si128(y, _mm_and_si128(x, _mm_set1_epi32(0xff)));
+}
+
+// box sums of 16 bytes to bytes, and the sums stepped on a row
+#define PX_BYTES 16
+
+static inline void px_sums_out_vec(uint8_t *out, const uint16_t *sum, uint16_t m) {
+    __m128i f = _mm_set1_epi16((int16_t)m);
+    __m128i lo = _mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)sum), f);
+    __m128i hi = _mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)(sum + 8)), f);
+    _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(lo, hi));
+}
+
+static inline void px_sums_step_vec(uint16_t *sum, const uint8_t *add, const uint8_t *sub) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_loadu_si128((const __m128i *)add);
+    __m128i b = _mm_loadu_si128((const __m128i *)sub);
+    __m128i lo = _mm_loadu_si128((const __m128i *)sum);
+    __m128i hi = _mm_loadu_si128((const __m128i *)(sum + 8));
+    lo = _mm_sub_epi16(_mm_add_epi16(lo, _mm_unpacklo_epi8(a, zero)), _mm_unpacklo_epi8(b, zero));
+    hi = _mm_sub_epi16(_mm_add_epi16(hi, _mm_unpackhi_epi8(a, zero)), _mm_unpackhi_epi8(b, zero));
+    _mm_storeu_si128((__m128i *)sum, lo);
+    _mm_storeu_si128((__m128i *)(sum + 8), hi);
+}
+
+#elif defined(PX_NEON)
+
+// high half of the 16 bit products of a and f
+static inline uint16x8_t px_mulhi_neon(uint16x8_t a, uint16x8_t f) {
+    uint32x4_t lo = vmull_u16(vget_low_u16(a), vget_low_u16(f));
+    uint32x4_t hi = vmull_u16(vget_high_u16(a), vget_high_u16(f));
+    return vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16));
+}
+
+// 4 pixels of x times f, plus the widened bytes t
+static inline uint32x4_t px_scale_neon(uint32x4_t x, uint16x8_t f, uint16x8_t t) {
+    uint8x16_t b = vreinterpretq_u8_u32(x);
+    uint16x8_t lo = vqaddq_u16(px_mulhi_neon(vshll_n_u8(vget_low_u8(b), 8), f), t);
+    uint16x8_t hi = vqaddq_u16(px_mulhi_neon(vshll_n_u8(vget_high_u8(b), 8), f), t);
+    return vreinterpretq_u32_u8(vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi)));
+}
+
+#define PX_STEP 4
+#define px_vec uint32x4_t
+#define px_load(p) vld1q_u32(p)
+#define px_store(p, x) vst1q_u32(p, x)
+#define px_splat16(f) vdupq_n_u16(f)
+#define px_widen(t) vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(t)))
+#define px_scale_vec px_scale_neon
+#define px_add8(x, y) vreinterpretq_u32_u8(vqaddq_u8(vreinterpretq_u8_u32(x), vreinterpretq_u8_u32(y)))
+
+static inline px_vec px_superpose_vec(px_vec x, px_vec y) {
+    return vbslq_u32(vceqq_u32(y, vdupq_n_u32(0)), x, y);
+}
+
+static inline px_vec px_argb_vec(px_vec x) {
+    return vsriq_n_u32(vshlq_n_u32(x, 24), x, 8);
+}
+
+static inline px_vec px_abgr_vec(px_vec x) {
+    return vreinterpretq_u32_u8(vrev32q_u8(vreinterpretq_u8_u32(x)));
+}
+
+// NEON has a de-interleaving load, so its grayscale kernel takes 16 pixels at a time
+static uint32_t px_grayscale_neon(uint32_t *p, uint32_t n) {
+    uint32_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        // little endian, so the planes are alpha, blue, green, red
+        uint8x16x4_t v = vld4q_u8((const uint8_t *)(p + i));
+        uint16x8_t lo = vmull_u8(vget_low_u8(v.val[3]), vdup_n_u8(77));
+        uint16x8_t hi = vmull_u8(vget_high_u8(v.val[3]), vdup_n_u8(77));
+        lo = vmlal_u8(lo, vget_low_u8(v.val[2]), vdup_n_u8(150));
+        hi = vmlal_u8(hi, vget_high_u8(v.val[2]), vdup_n_u8(150));
+        lo = vmlal_u8(lo, vget_low_u8(v.val[1]), vdup_n_u8(29));
+        hi = vmlal_u8(hi, vget_high_u8(v.val[1]), vdup_n_u8(29));
+        v.val[1] = v.val[2] = v.val[3] = vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+        vst4q_u8((uint8_t *)(p + i), v);
+    }
+    return i;
+}
+
+// box sums of 16 bytes to bytes, and the sums stepped on a row
+#define PX_BYTES 16
+
+static inline void px_sums_out_vec(uint8_t *out, const uint16_t *sum, uint16_t m) {
+    uint16x8_t f = vdupq_n_u16(m);
+    uint16x8_t lo = px_mulhi_neon(vld1q_u16(sum), f);
+    uint16x8_t hi = px_mulhi_neon(vld1q_u16(sum + 8), f);
+    vst1q_u8(out, vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi)));
+}
+
+static inline void px_sums_step_vec(uint16_t *sum, const uint8_t *add, const uint8_t *sub) {
+    uint8x16_t a = vld1q_u8(add);
+    uint8x16_t b = vld1q_u8(sub);
+    uint16x8_t lo = vsubw_u8(vaddw_u8(vld1q_u16(sum), vget_low_u8(a)), vget_low_u8(b));
+    uint16x8_t hi = vsubw_u8(vaddw_u8(vld1q_u16(sum + 8), vget_high_u8(a)), vget_high_u8(b));
+    vst1q_u16(sum, lo);
+    vst1q_u16(sum + 8, hi);
+}
+
+#endif
+
+/*
+ * the operations, vector kernels over whole vectors and the reference over the rest
+ */
+
+void px_shade(uint32_t *p, uint32_t n, uint16_t f) {
+    f = min(f, PX_FACTOR_MAX);
+    uint32_t i = 0;
+#ifdef PX_STEP
+    const px_vec vf = px_splat16(f);
+    const px_vec vt = px_splat16(0);
+    for (; i + PX_STEP <= n; i += PX_STEP) {
+        px_store(p + i, px_scale_vec(px_load(p + i), vf, vt));
+    }
+#endif
+    px_shade_ref(p + i, n - i, f);
+}
+
+void px_blend(uint32_t *p, const uint32_t *q, uint32_t n, uint16_t f) {
+    f = min(f, PX_ONE);
+    uint32_t i = 0;
+#ifdef PX_STEP
+    const px_vec vf = px_splat16(f);
+    const px_vec vg = px_splat16(PX_ONE - f);
+    const px_vec vt = px_splat16(0);
+    for (; i + PX_STEP <= n; i += PX_STEP) {
+        // the two products sum to at most 255 per channel, so no carry crosses a byte
+        px_vec x = px_scale_vec(px_load(p + i), vf, vt);
+        px_vec y = px_scale_vec(px_load(q + i), vg, vt);
+        px_store(p + i, px_add8(x, y));
+    }
+#endif
+    px_blend_ref(p + i, q + i, n - i, f);
+}
+
+void px_tinge(uint32_t *p, uint32_t n, uint32_t tint, uint16_t f) {
+    f = min(f, PX_ONE);
+    uint32_t i = 0;
+#ifdef PX_STEP
+    const px_vec vf = px_splat16(f);
+    const px_vec vt = px_widen(px_scale(tint, PX_ONE - f, 0));
+    for (; i + PX_STEP <= n; i += PX_STEP) {
+        px_store(p + i, px_scale_vec(px_load(p + i), vf, vt));
+    }
+#endif
+    px_tinge_ref(p + i, n - i, tint, f);
+}
+
+void px_superpose(uint32_t *p, const uint32_t *q, uint32_t n) {
+    uint32_t i = 0;
+#ifdef PX_STEP
+    for (; i + PX_STEP <= n; i += PX_STEP) {
+        px_store(p + i, px_superpose_vec(px_load(p + i), px_load(q + i)));
+    }
+#endif
+    px_superpose_ref(p + i, q + i, n - i);
+}
+
+void px_convert(uint32_t *p, const uint32_t *q, uint32_t n, enum px_order o) {
+    uint32_t i = 0;
+    if (o == PX_RGBA) {
+        memmove(p, q, n * sizeof(*p));
+        return;
+    }
+#ifdef PX_STEP
+    if (o == PX_ARGB) {
+        for (; i + PX_STEP <= n; i += PX_STEP) {
+            px_store(p + i, px_argb_vec(px_load(q + i)));
+        }
+    } else {
+        for (; i + PX_STEP <= n; i += PX_STEP) {
+            px_store(p + i, px_abgr_vec(px_load(q + i)));
+        }
+    }
+#endif
+    px_convert_ref(p + i, q + i, n - i, o);
+}
+
+void px_grayscale(uint32_t *p, uint32_t n) {
+    uint32_t i = 0;
+#if defined(PX_NEON)
+    i = px_grayscale_neon(p, n);
+#elif defined(PX_STEP)
+    for (; i + PX_STEP <= n; i += PX_STEP) {
+        px_store(p + i, px_grayscale_vec(px_load(p + i)));
+    }
+#endif
+    px_grayscale_ref(p + i, n - i);
+}
+
+static void px_sums_out(uint8_t *out, const uint16_t *sum, uint32_t n, uint16_t m) {
+    uint32_t j = 0;
+#ifdef PX_BYTES
+    for (; j + PX_BYTES <= n; j += PX_BYTES) {
+        px_sums_out_vec(out + j, sum + j, m);
+    }
+#endif
+    px_sums_out_ref(out + j, sum + j, n - j, m);
+}
+
+static void px_sums_step(uint16_t *sum, const uint8_t *add, const uint8_t *sub, uint32_t n) {
+    uint32_t j = 0;
+#ifdef PX_BYTES
+    for (; j + PX_BYTES <= n; j += PX_BYTES) {
+        px_sums_step_vec(sum + j, add + j, sub + j);
+    }
+#endif
+    px_sums_step_ref(sum + j, add + j, sub + j, n - j);
+}
+
+/*
+ * box blur
+ * Running sums per byte, so the cost doesn't grow with the radius, and 1 / (2 radius + 1)
+ * as a 0.16 fixed point factor rounded up, so a full box of 255 gives 255.
+ */
+
+static inline uint16_t px_box_factor(int radius) {
+    return (uint16_t)((65536 + 2 * radius) / (2 * radius + 1));
+}
+
+// the four bytes of a pixel spread to 16 bit fields, so one 64 bit add sums all channels
+static inline uint64_t px_spread(uint32_t x) {
+    uint64_t y = x;
+    y = (y | y << 16) & 0x0000ffff0000ffffULL;
+    return (y | y << 8) & 0x00ff00ff00ff00ffULL;
+}
+
+// index i clamped to the image, 0 to n - 1
+static inline uint32_t px_edge(long i, uint32_t n) {
+    return (uint32_t)min(max(i, 0L), (long)n - 1);
+}
+
+void px_box_rows(const uint32_t *src, uint32_t *dst, uint32_t w, uint32_t first, uint32_t last, int radius) {
+    const uint16_t m = px_box_factor(radius);
+    const uint32_t r = radius;
+    // the row widened, with its edge pixels repeated radius + 1 times beyond each end
+    uint64_t wide[w + 2 * r + 2];
+    uint64_t sum[w];
+    for (uint32_t y = first; y < last; y++) {
+        const uint32_t *in = src + (size_t)y * w;
+        for (uint32_t x = 0; x < w; x++) {
+            wide[x + r + 1] = px_spread(in[x]);
+        }
+        for (uint32_t i = 0; i <= r; i++) {
+            wide[i] = wide[r + 1];
+            wide[w + r + 1 + i] = wide[w + r];
+        }
+        // sum[x] is the box from x - r to x + r; the fields never go negative,
+        // so no borrow crosses them
+        uint64_t s = 0;
+        for (uint32_t i = 1; i <= 2 * r + 1; i++) {
+            s += wide[i];
+        }
+        for (uint32_t x = 0; x < w; x++) {
+            sum[x] = s;
+            s += wide[x + 2 * r + 2];
+            s -= wide[x + 1];
+        }
+        // the fields of each sum lie in memory in the order of the pixel's bytes
+        px_sums_out((uint8_t *)(dst + (size_t)y * w), (const uint16_t *)sum, 4 * w, m);
+    }
+}
+
+void px_box_columns(const uint32_t *src, uint32_t *dst, uint32_t w, uint32_t h, uint32_t first, uint32_t last, int radius) {
+    const uint32_t n = 4 * w;
+    uint16_t sum[n];
+    const uint16_t m = px_box_factor(radius);
+    const uint8_t *in = (const uint8_t *)src;
+    // the sums run down the stripe a row at a time, so each row is read once per edge of the box
+    memset(sum, 0, sizeof(sum));
+    for (long i = (long)first - radius; i <= (long)first + radius; i++) {
+        const uint8_t *row = in + (size_t)px_edge(i, h) * n;
+        for (uint32_t j = 0; j < n; j++) {
+            sum[j] += row[j];
+        }
+    }
+    for (uint32_t y = first; y < last; y++) {
+        px_sums_out((uint8_t *)dst + (size_t)y * n, sum, n, m);
+        px_sums_step(sum, in + (size_t)px_edge((long)y + radius + 1, h) * n,
+                in + (size_t)px_edge((long)y - radius, h) * n, n);
+    }
+}
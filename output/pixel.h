@@ -0,0 +1,57 @@
+// Whole-buffer pixel operations on packed RGBA8888 pixels.
+// Factors are 8.8 fixed point (256 is 1.0) and every channel, alpha included, is
+// treated alike, so the results don't depend on byte order. Each operation has a
+// scalar reference, px_*_ref, which the vector kernels (SSE2, AVX2 or NEON, chosen
+// at compile time) match bit for bit; they run it over the few pixels left at the end.
+
+#pragma once
+
+#include <stdint.h>
+
+// largest box blur radius, so that a sum of 2 radius + 1 bytes fits 16 bits
+#define PX_BLUR_RADIUS_MAX 64
+
+// persistence as an 8.8 fixed point factor, saturated to the representable range;
+// rounded down, so any persistence under 1 still fades
+uint16_t px_factor(double persistence);
+
+// p = min(255, p f >> 8) per channel
+void px_shade(uint32_t *p, uint32_t n, uint16_t f);
+void px_shade_ref(uint32_t *p, uint32_t n, uint16_t f);
+
+// p = (p f >> 8) + (q (256 - f) >> 8) per channel, for f up to 256
+void px_blend(uint32_t *p, const uint32_t *q, uint32_t n, uint16_t f);
+void px_blend_ref(uint32_t *p, const uint32_t *q, uint32_t n, uint16_t f);
+
+// p = (p f >> 8) + (tint (256 - f) >> 8) per channel, for f up to 256
+void px_tinge(uint32_t *p, uint32_t n, uint32_t tint, uint16_t f);
+void px_tinge_ref(uint32_t *p, uint32_t n, uint32_t tint, uint16_t f);
+
+// p = q wherever q is not 0
+void px_superpose(uint32_t *p, const uint32_t *q, uint32_t n);
+void px_superpose_ref(uint32_t *p, const uint32_t *q, uint32_t n);
+
+// the byte orders of the 32 bit formats RGBA8888 pixels can be written in: RGBA8888,
+// ARGB8888 (or RGB888) and ABGR8888 (or BGR888)
+enum px_order {PX_RGBA, PX_ARGB, PX_ABGR};
+
+// p = q in byte order o; p may be q
+void px_convert(uint32_t *p, const uint32_t *q, uint32_t n, enum px_order o);
+void px_convert_ref(uint32_t *p, const uint32_t *q, uint32_t n, enum px_order o);
+
+// red, green and blue to the BT.601 luma (77 r + 150 g + 29 b) >> 8, alpha kept
+void px_grayscale(uint32_t *p, uint32_t n);
+void px_grayscale_ref(uint32_t *p, uint32_t n);
+
+// colour over p by coverage, p = (colour f + p (256 - f)) >> 8 per channel with
+// f = cover + (cover >> 7); spans of glyphs are short, so this works two channels to a
+// word rather than in vectors
+void px_cover(uint32_t *p, const uint8_t *cover, uint32_t n, uint32_t colour);
+
+// one pass of a 2 radius + 1 wide box filter along rows first to last - 1 of src, w pixels
+// wide, into the same rows of dst, which may be src; edge pixels extend beyond the image
+void px_box_rows(const uint32_t *src, uint32_t *dst, uint32_t w, uint32_t first, uint32_t last, int radius);
+
+// the same down the columns of an image h rows high, for rows first to last - 1 of dst;
+// src must not be dst
+void px_box_columns(const uint32_t *src, uint32_t *dst, uint32_t w, uint32_t h, uint32_t first, uint32_t last, int radius);
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "output/pool.h"
+
+#include "debug.h"
+#include "util.h"
+
+
+// claim and run jobs of the current task until none are left; called with the lock held
+static void pool_work(struct pool *pl) {
+    while (pl->next < pl->jobs) {
+        int job = pl->next++;
+        pthread_mutex_unlock(&pl->lock);
+        pl->job(pl->arg, job);
+        pthread_mutex_lock(&pl->lock);
+        if (--pl->pending == 0) {
+            pthread_cond_signal(&pl->done);
+        }
+    }
+}
+
+static void *pool_thread(void *data) {
+    struct pool *pl = data;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&pl->lock);
+    for (;;) {
+        while (!pl->quit && pl->generation == seen) {
+            pthread_cond_wait(&pl->start, &pl->lock);
+        }
+        if (pl->quit)
+            break;
+        seen = pl->generation;
+        pool_work(pl);
+    }
+    pthread_mutex_unlock(&pl->lock);
+    return NULL;
+}
+
+// start threads - 1 workers (0 for one thread per core), the caller being the last
+void pool_init(struct pool *pl, int threads) {
+    memset(pl, 0, sizeof(*pl));
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    pl->threads = max(0, threads - 1);
+    pthread_mutex_init(&pl->lock, NULL);
+    pthread_cond_init(&pl->start, NULL);
+    pthread_cond_init(&pl->done, NULL);
+    pl->thread = calloc(max(1, pl->threads), sizeof(pthread_t));
+    for (int n = 0; n < pl->threads; n++) {
+        pthread_create(&pl->thread[n], NULL, pool_thread, pl);
+    }
+    debug("pool: %d render threads\n", pl->threads + 1);
+}
+
+// run job(arg, n) for n = 0 to jobs - 1 across the pool, and wait for all of them
+void pool_run(struct pool *pl, pool_job job, void *arg, int jobs) {
+    if (pl->threads == 0 || jobs <= 1) {
+        for (int n = 0; n < jobs; n++) {
+            job(arg, n);
+        }
+        return;
+    }
+    pthread_mutex_lock(&pl->lock);
+    pl->job = job;
+    pl->arg = arg;
+    pl->jobs = jobs;
+    pl->next = 0;
+    pl->pending = jobs;
+    pl->generation++;
+    pthread_cond_broadcast(&pl->start);
+    pool_work(pl);
+    while (pl->pending > 0) {
+        pthread_cond_wait(&pl->done, &pl->lock);
+    }
+    pthread_mutex_unlock(&pl->lock);
+}
+
+void pool_free(struct pool *pl) {
+    pthread_mutex_lock(&pl->lock);
+    pl->quit = true;
+    pthread_cond_broadcast(&pl->start);
+    pthread_mutex_unlock(&pl->lock);
+    for (int n = 0; n < pl->threads; n++) {
+        pthread_join(pl->thread[n], NULL);
+    }
+    free(pl->thread);
+    pthread_mutex_destroy(&pl->lock);
+    pthread_cond_destroy(&pl->start);
+    pthread_cond_destroy(&pl->done);
+}
@@ -0,0 +1,30 @@
+// A fixed pool of worker threads for the renderer.
+// pool_run() hands out the jobs 0 to jobs - 1 of one task across the workers and the
+// calling thread, and returns when they have all finished. Jobs write disjoint parts
+// of the output, so the result doesn't depend on which thread ran which job.
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+
+typedef void (*pool_job)(void *arg, int job);
+
+struct pool {
+    int threads;                // workers, not counting the caller
+    pthread_t *thread;
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    // the task in hand, its next unclaimed job, and jobs still running or unclaimed
+    pool_job job;
+    void *arg;
+    int jobs, next, pending;
+    unsigned long generation;   // counts tasks, so a worker sees each once
+    bool quit;
+};
+
+void pool_init(struct pool *pl, int threads);
+
+void pool_run(struct pool *pl, pool_job job, void *arg, int jobs);
+
+void pool_free(struct pool *pl);
@@ -0,0 +1,107 @@
+// Pixel writes for the plot primitives, which clip what they draw to the buffer once and
+// then write inside it unchecked: single pixels, and runs of one colour along a row or
+// down a column. Pixels outside the buffer are dropped by the primitives rather than
+// wrapped round to the other side.
+// In a debug build (--enable-debug, without NDEBUG) every write is checked against the
+// buffer, and one outside it is reported and aborts.
+
+#pragma once
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "output/render.h"
+#include "util.h"
+
+// a part of a buffer, x0 <= x < x1 and y0 <= y < y1; inside is whether it was all in the
+// buffer before it was clipped, so the pixels of a primitive within it need no checks
+typedef struct {
+    long x0, y0, x1, y1;
+    bool inside;
+} raster_box;
+
+static inline bool raster_inside(const buffer buff, long x, long y) {
+    return x >= 0 && y >= 0 && x < (long)buff.w && y < (long)buff.h;
+}
+
+#ifdef NDEBUG
+#define raster_check(buff, x, y) ((void)0)
+#else
+#define raster_check(buff, x, y) raster_check_at(buff, x, y, __FILE__, __LINE__)
+static inline void raster_check_at(const buffer buff, long x, long y, const char *file, int line) {
+    if (!raster_inside(buff, x, y)) {
+        fprintf(stderr, "%s:%d: pixel %ld, %ld outside the %ux%u buffer\n", file, line, x, y, buff.w, buff.h);
+        abort();
+    }
+}
+#endif
+
+// x0 <= x < x1, y0 <= y < y1 clipped to buff, which is empty if it misses it
+static inline raster_box raster_clip(const buffer buff, long x0, long y0, long x1, long y1) {
+    raster_box b = {
+        max(x0, 0L), max(y0, 0L), min(x1, (long)buff.w), min(y1, (long)buff.h),
+        x0 >= 0 && y0 >= 0 && x1 <= (long)buff.w && y1 <= (long)buff.h,
+    };
+    return b;
+}
+
+static inline bool raster_empty(raster_box b) {
+    return b.x0 >= b.x1 || b.y0 >= b.y1;
+}
+
+// nothing, to be grown by raster_extend() as pixels are plotted
+static inline raster_box raster_none(void) {
+    raster_box b = {LONG_MAX, LONG_MAX, LONG_MIN, LONG_MIN, true};
+    return b;
+}
+
+static inline void raster_extend(raster_box *b, long x, long y) {
+    b->x0 = min(b->x0, x);
+    b->y0 = min(b->y0, y);
+    b->x1 = max(b->x1, x + 1);
+    b->y1 = max(b->y1, y + 1);
+}
+
+// the pixel at x, y, which must be in the buffer
+static inline pixel *raster_at(const buffer buff, long x, long y) {
+    raster_check(buff, x, y);
+    return buff.pixels + (size_t)y * buff.w + x;
+}
+
+static inline void raster_put(const buffer buff, long x, long y, pixel p) {
+    *raster_at(buff, x, y) = p;
+}
+
+// a pixel of a primitive whose extent is b: unchecked if that was all inside the buffer,
+// and dropped if it is outside
+static inline void raster_plot(const buffer buff, const raster_box *b, long x, long y, pixel p) {
+    if (b->inside || raster_inside(buff, x, y)) {
+        raster_put(buff, x, y, p);
+    }
+}
+
+// x0 <= x < x1 along row y, which must be in the buffer
+static inline void raster_hspan(const buffer buff, long x0, long x1, long y, pixel p) {
+    if (x0 >= x1)
+        return;
+    raster_check(buff, x0, y);
+    raster_check(buff, x1 - 1, y);
+    pixel *row = buff.pixels + (size_t)y * buff.w;
+    for (long x = x0; x < x1; x++) {
+        row[x] = p;
+    }
+}
+
+// y0 <= y < y1 down column x, which must be in the buffer
+static inline void raster_vspan(const buffer buff, long x, long y0, long y1, pixel p) {
+    if (y0 >= y1)
+        return;
+    raster_check(buff, x, y0);
+    raster_check(buff, x, y1 - 1);
+    pixel *q = buff.pixels + (size_t)y0 * buff.w + x;
+    for (long y = y0; y < y1; y++, q += buff.w) {
+        *q = p;
+    }
+}
@@ -1,20 +1,97 @@
+#include "debug.h"
+#include "pixel.h"
 #include "render.h"
 #include "util.h"
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 
 SDL_Window *gWindow = NULL;
 SDL_Renderer *gRenderer = NULL;
-SDL_Texture *gTarget = NULL;
+// a texture per layer, which match pixel-to-pixel to the layers' buffers
+SDL_Texture *gLayer[LAYERS] = {NULL};
+// layers above the first are screened onto it, s + d (1 - s)
+SDL_BlendMode gScreen;
+bool gLayered = false;
+// without custom blend modes, or when streaming, the layers are superposed on the CPU
+// instead, a row at a time through gRow, straight into one of two streaming textures in
+// turn, in the window's format; each frame redraws what changed in the last as well,
+// which the other texture missed
+SDL_Texture *gStream[2] = {NULL};
+int gFrame = 0;
+enum px_order gOrder = PX_RGBA;
+pixel *gRow = NULL;
+damage gLast = {0};
+// the layers last shown, and whether the window needs every layer uploaded and presented
+// whatever has changed
+bool gShown[LAYERS] = {false};
+bool gStale = true;
+// new pixels of fading layers go through gTrace onto the layer's texture, which keeps the
+// last frame
+SDL_Texture *gTrace = NULL;
+// d - s, which takes the last levels a fade rounds back to themselves down to 0
+SDL_BlendMode gDecay;
+bool gFading = false;
+bool gFaded[LAYERS] = {false};
+// the renderer has lost what was drawn into the layers' textures
+bool gReset = false;
 
 SDL_Event e;
 
 SDL_Color fg_color = {0};
 SDL_Color bg_color = {0};
 
+static long rect_area(SDL_Rect r) {
+    return (long)r.w * r.h;
+}
+
+static SDL_Rect rect_union(SDL_Rect a, SDL_Rect b) {
+    if (a.w <= 0 || a.h <= 0)
+        return b;
+    int x0 = min(a.x, b.x), y0 = min(a.y, b.y);
+    int x1 = max(a.x + a.w, b.x + b.w), y1 = max(a.y + a.h, b.y + b.h);
+    SDL_Rect u = {x0, y0, x1 - x0, y1 - y0};
+    return u;
+}
+
+void damage_add(damage *d, SDL_Rect r) {
+    if (d == NULL || r.w <= 0 || r.h <= 0)
+        return;
+    d->extent = rect_union(d->extent, r);
+    for (;;) {
+        // the rectangle the union with which wastes least area
+        int best = -1;
+        long least = 0;
+        for (int n = 0; n < d->rects; n++) {
+            SDL_Rect u = rect_union(d->rect[n], r);
+            if (rect_area(u) == rect_area(d->rect[n]))
+                return;
+            long waste = rect_area(u) - rect_area(d->rect[n]) - rect_area(r);
+            if (best < 0 || waste < least) {
+                best = n;
+                least = waste;
+            }
+        }
+        // rectangles apart are kept apart while there is room
+        if (best < 0 || (least > 0 && d->rects < DAMAGE_RECTS)) {
+            d->rect[d->rects++] = r;
+            return;
+        }
+        // merged, the union may now meet another
+        r = rect_union(d->rect[best], r);
+        d->rect[best] = d->rect[--d->rects];
+    }
+}
+
+void damage_clear(damage *d) {
+    if (d != NULL) {
+        d->rects = 0;
+    }
+}
+
 // get the fullscreen size
 //int w, h;
 //SDL_GetRendererOutputSize(renderer, &w, &h);
@@ -40,7 +117,31 @@ int load_font(TTF_Font* font, char* font_name, int ptsize) {
 }
 
 // TODO: how does this differentiate between bg and fg col?
-void sdl_init(int w, int h, rgba *fg_color, rgba *bg_color, int rotate, bool fullscreen) {
+// streaming textures in the window's format, where pixels can be written in it
+static void sdl_stream_init(int w, int h) {
+    Uint32 format = SDL_GetWindowPixelFormat(gWindow);
+    switch (format) {
+    case SDL_PIXELFORMAT_ARGB8888:
+    case SDL_PIXELFORMAT_RGB888:
+        gOrder = PX_ARGB;
+        break;
+    case SDL_PIXELFORMAT_ABGR8888:
+    case SDL_PIXELFORMAT_BGR888:
+        gOrder = PX_ABGR;
+        break;
+    default:
+        // SDL converts any other
+        format = SDL_PIXELFORMAT_RGBA8888;
+        gOrder = PX_RGBA;
+        break;
+    }
+    for (int k = 0; k < 2; k++) {
+        gStream[k] = SDL_CreateTexture(gRenderer, format, SDL_TEXTUREACCESS_STREAMING, w, h);
+    }
+    gRow = calloc(w, sizeof(pixel));
+}
+
+void sdl_init(int w, int h, rgba *fg_color, rgba *bg_color, int rotate, bool fullscreen, bool streaming) {
 
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
@@ -73,9 +174,33 @@ void sdl_init(int w, int h, rgba *fg_color, rgba *bg_color, int rotate, bool ful
     // pixel interpolation
     SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1");
 
-    // the main target and buffer texture, which matches pixel-to-pixel to the buffer object
-    // so will have to be rotated when rendered
-    gTarget = SDL_CreateTexture(gRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
+    // the buffers' alpha isn't used, so black is what is transparent
+    gScreen = SDL_ComposeCustomBlendMode(
+            SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_COLOR, SDL_BLENDOPERATION_ADD,
+            SDL_BLENDFACTOR_ZERO, SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_ADD);
+    if (!streaming) {
+        // the layers' textures, which will have to be rotated when rendered
+        for (int n = 0; n < LAYERS; n++) {
+            gLayer[n] = SDL_CreateTexture(gRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
+        }
+        gLayered = SDL_SetTextureBlendMode(gLayer[LAYER_OVERLAY], gScreen) == 0;
+    }
+    if (!gLayered) {
+        debug("layers are composited on the CPU: %s\n", streaming ? "streaming" : SDL_GetError());
+        for (int n = 0; n < LAYERS; n++) {
+            SDL_DestroyTexture(gLayer[n]);
+            gLayer[n] = NULL;
+        }
+        sdl_stream_init(w, h);
+    } else if (SDL_RenderTargetSupported(gRenderer)) {
+        gTrace = SDL_CreateTexture(gRenderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, w, h);
+        gDecay = SDL_ComposeCustomBlendMode(
+                SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_REV_SUBTRACT,
+                SDL_BLENDFACTOR_ZERO, SDL_BLENDFACTOR_ONE, SDL_BLENDOPERATION_ADD);
+        gFading = gTrace != NULL && SDL_SetTextureBlendMode(gTrace, gScreen) == 0
+            && SDL_SetRenderDrawBlendMode(gRenderer, gDecay) == 0;
+    }
+    debug("layers are faded on the %s\n", gFading ? "renderer" : "CPU");
 
     if (TTF_Init() < 0) {
         printf("TTF could not initialize! TTF_Error: %s\n", TTF_GetError());
@@ -114,14 +239,142 @@ int sdl_text(SDL_Texture *target, TTF_Font *font, char *text, int center, uint32
 }
 */
 
-int sdl_blit(const buffer buff, int frame_time_ms, int rotate) {
+bool sdl_can_fade(void) {
+    return gFading;
+}
+
+// fade the texture of layer n, and screen the layer's new pixels onto it
+static void sdl_fade(int n, const layer *l) {
+    damage *d = l->buff.damage;
+    for (int k = 0; k < d->rects; k++) {
+        const SDL_Rect *r = &d->rect[k];
+        SDL_UpdateTexture(gTrace, r, l->buff.pixels + r->y * l->buff.w + r->x, l->buff.w * sizeof(pixel));
+    }
+    SDL_SetRenderTarget(gRenderer, gLayer[n]);
+    // the window's scale is put back with the target
+    SDL_RenderSetScale(gRenderer, 1, 1);
+    // d = d (1 - a), which is d * fade
+    SDL_SetRenderDrawBlendMode(gRenderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, (Uint8)(255 * (1 - l->fade) + 0.5));
+    SDL_RenderFillRect(gRenderer, NULL);
+    // the blend rounds to nearest, so a level below 0.5 / (1 - fade) would never fade
+    // further; d - 1 takes it down to 0, as the truncation of the CPU fade does
+    SDL_SetRenderDrawBlendMode(gRenderer, gDecay);
+    SDL_SetRenderDrawColor(gRenderer, 1, 1, 1, 0);
+    SDL_RenderFillRect(gRenderer, NULL);
+    for (int k = 0; k < d->rects; k++) {
+        SDL_RenderCopy(gRenderer, gTrace, &d->rect[k], &d->rect[k]);
+    }
+    SDL_SetRenderTarget(gRenderer, NULL);
+    damage_clear(d);
+}
+
+int sdl_blit(layer layers[LAYERS], int frame_time_ms, int rotate) {
 
     // SDL_Delay doesn't seem to work?
     SDL_Delay(frame_time_ms);
 
-    // texture matches buffer dimensions (not yet rotated)
-    SDL_UpdateTexture(gTarget, NULL, buff.pixels, buff.w * sizeof(pixel));
-    SDL_Rect texture_rect = {0, 0, buff.w, buff.h};
+    // textures match the buffers' dimensions (not yet rotated)
+    const buffer buff = layers[LAYER_DYNAMIC].buff;
+    SDL_Rect all = {0, 0, buff.w, buff.h};
+    // the textures to draw, bottom to top
+    SDL_Texture *texture[LAYERS] = {NULL};
+    bool changed = gStale;
+    for (int n = 0; n < LAYERS; n++) {
+        bool fading = gFading && layers[n].shown && layers[n].fade > 0;
+        changed = changed || layers[n].shown != gShown[n] || (layers[n].shown && layers[n].buff.damage->rects) || fading;
+        // a layer that stops fading has only its buffer to show, and a stale window
+        // shows every buffer whole
+        if ((gFaded[n] && !fading) || gStale) {
+            damage_add(layers[n].buff.damage, all);
+        }
+        gFaded[n] = fading;
+    }
+    if (!changed) {
+        // nothing new to show
+    } else if (gLayered) {
+        // upload only what has changed of the layers shown
+        for (int n = 0; n < LAYERS; n++) {
+            damage *d = layers[n].buff.damage;
+            if (gFaded[n] && gReset) {
+                // the trail went with the texture, so it starts again from the buffer
+                SDL_SetRenderTarget(gRenderer, gLayer[n]);
+                SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 0);
+                SDL_RenderClear(gRenderer);
+                SDL_SetRenderTarget(gRenderer, NULL);
+            }
+            if (gFaded[n]) {
+                sdl_fade(n, &layers[n]);
+            } else if (layers[n].shown) {
+                for (int k = 0; k < d->rects; k++) {
+                    const SDL_Rect *r = &d->rect[k];
+                    SDL_UpdateTexture(gLayer[n], r, layers[n].buff.pixels + r->y * layers[n].buff.w + r->x, layers[n].buff.w * sizeof(pixel));
+                }
+                damage_clear(d);
+            }
+            texture[n] = layers[n].shown ? gLayer[n] : NULL;
+        }
+    } else {
+        // what has changed in any layer shown, or all of it if the layers shown have
+        damage region = {0};
+        for (int n = 0; n < LAYERS; n++) {
+            damage *d = layers[n].buff.damage;
+            if (layers[n].shown != gShown[n] || gStale) {
+                damage_add(&region, all);
+            } else if (layers[n].shown) {
+                for (int k = 0; k < d->rects; k++) {
+                    damage_add(&region, d->rect[k]);
+                }
+            }
+            if (layers[n].shown) {
+                damage_clear(d);
+            }
+        }
+        damage redraw = region;
+        for (int k = 0; k < gLast.rects; k++) {
+            damage_add(&redraw, gLast.rect[k]);
+        }
+        gLast = region;
+        gFrame = !gFrame;
+        for (int k = 0; k < redraw.rects; k++) {
+            const SDL_Rect *r = &redraw.rect[k];
+            // the locked pixels are only written, as they needn't hold what the texture does
+            void *locked;
+            int pitch;
+            if (SDL_LockTexture(gStream[gFrame], r, &locked, &pitch) < 0) {
+                debug("could not lock the texture: %s\n", SDL_GetError());
+                break;
+            }
+            for (int y = r->y; y < r->y + r->h; y++) {
+                pixel *dst = (pixel*)((uint8_t*)locked + (size_t)(y - r->y) * pitch);
+                const pixel *row = NULL;
+                for (int n = 0; n < LAYERS; n++) {
+                    if (!layers[n].shown)
+                        continue;
+                    const pixel *src = layers[n].buff.pixels + y * layers[n].buff.w + r->x;
+                    if (row == NULL) {
+                        row = src;
+                    } else {
+                        if (row != gRow) {
+                            memcpy(gRow, row, r->w * sizeof(pixel));
+                            row = gRow;
+                        }
+                        px_superpose(gRow, src, r->w);
+                    }
+                }
+                if (row == NULL) {
+                    memset(dst, 0, r->w * sizeof(pixel));
+                } else {
+                    px_convert(dst, row, r->w, gOrder);
+                }
+            }
+            SDL_UnlockTexture(gStream[gFrame]);
+        }
+        texture[0] = gStream[gFrame];
+    }
+    for (int n = 0; n < LAYERS; n++) {
+        gShown[n] = layers[n].shown;
+    }
 
     // work around https://stackoverflow.com/questions/28123292/sdl-rendersetscale-incorrectly-applies-to-rotated-bitmaps-in-sdl2-2-0-3
     int window_w, window_h;
@@ -136,22 +389,57 @@ int sdl_blit(const buffer buff, int frame_time_ms, int rotate) {
                 );
     }
 
-    SDL_RenderCopyExF(gRenderer, gTarget, &texture_rect, NULL, rotate * 90, NULL, FLIP);
-    SDL_RenderPresent(gRenderer);
+    // the lowest layer is copied, and those above screened onto it
+    if (changed) {
+        bool first = true;
+        for (int n = 0; n < LAYERS; n++) {
+            if (texture[n] == NULL)
+                continue;
+            SDL_SetTextureBlendMode(texture[n], first ? SDL_BLENDMODE_NONE : gScreen);
+            SDL_RenderCopyExF(gRenderer, texture[n], &all, NULL, rotate * 90, NULL, FLIP);
+            first = false;
+        }
+        SDL_RenderPresent(gRenderer);
+        gStale = false;
+        gReset = false;
+    }
 
     int rc = 0;
-    SDL_PollEvent(&e);
-    if (e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
-        rc = -1;
-    if (e.type == SDL_QUIT)
-        rc = -2;
+    // e is only this frame's event if there was one
+    if (SDL_PollEvent(&e)) {
+        // exposed, resized and so on
+        if (e.type == SDL_WINDOWEVENT)
+            gStale = true;
+        if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+            rc = -1;
+        if (e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET)
+            sdl_reset();
+        if (e.type == SDL_QUIT)
+            rc = -2;
+    }
 
     return rc;
 }
 
+void sdl_stale(void) {
+    gStale = true;
+}
+
+void sdl_reset(void) {
+    gStale = true;
+    gReset = true;
+}
+
 void sdl_cleanup(void) {
     TTF_Quit();
-    SDL_DestroyTexture(gTarget);
+    for (int n = 0; n < LAYERS; n++) {
+        SDL_DestroyTexture(gLayer[n]);
+    }
+    SDL_DestroyTexture(gTrace);
+    for (int k = 0; k < 2; k++) {
+        SDL_DestroyTexture(gStream[k]);
+    }
+    free(gRow);
     SDL_DestroyWindow(gWindow);
     SDL_Quit();
 }
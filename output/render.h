@@ -1,3 +1,5 @@
+#pragma once
+
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 
@@ -10,19 +12,57 @@
 typedef uint32_t pixel;
 typedef SDL_Color rgba;
 
+// rectangles kept of the damage to a buffer; more are merged
+#define DAMAGE_RECTS 4
+
+// the parts of a buffer changed since it was last uploaded, and the part that may not be 0
+typedef struct {
+    int rects;
+    SDL_Rect rect[DAMAGE_RECTS];
+    SDL_Rect extent;
+} damage;
+
 // a screen buffer, local RGBA8888 format
+// buffers are passed by value, so the damage to them is kept apart
 typedef struct {
     uint32_t h;
     uint32_t w;
     uint32_t size;
     pixel *pixels;
+    damage *damage;
 } buffer;
 
+// the layers of the display, composited bottom to top: a background redrawn only when it
+// changes, such as axes and dials, the traces, and text and readouts over them
+enum layer_id {LAYER_STATIC, LAYER_DYNAMIC, LAYER_OVERLAY, LAYERS};
+
+// a layer's pixels, and whether it is shown at all; what has changed since it was last
+// uploaded is in the buffer's damage
+// with fade > 0 the layer's texture keeps its last frame, faded by that much on the
+// renderer, and the buffer holds only what is drawn over it, which is screened on
+typedef struct {
+    buffer buff;
+    bool shown;
+    double fade;
+} layer;
+
+
+// add r to the damage d, and to its extent
+void damage_add(damage *d, SDL_Rect r);
+void damage_clear(damage *d);
 
 void parse_color(char *color_string, SDL_Color *color);
 int load_font(TTF_Font* font, char* font_name, int ptsize);
-void sdl_init(int w, int h, rgba *fg_color, rgba *bg_color, int rotate, bool fullscreen);
+// streaming composites the layers on the CPU straight into textures in the window's format
+void sdl_init(int w, int h, rgba *fg_color, rgba *bg_color, int rotate, bool fullscreen, bool streaming);
 int sdl_text(char* text, int length);
-int sdl_blit(const buffer buff, int frame_time_ms, int rotate);
+int sdl_blit(layer layers[LAYERS], int frame_time_ms, int rotate);
+// redraw every layer whole at the next blit, as when the window has been exposed
+void sdl_stale(void);
+// as sdl_stale(), when the renderer has lost what the textures held, and the trails of
+// fading layers with it
+void sdl_reset(void);
+// whether layers can be faded on the renderer, which needs render targets and custom blend modes
+bool sdl_can_fade(void);
 void sdl_cleanup(void);
 
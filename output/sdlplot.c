@@ -11,11 +11,24 @@
 #include "debug.h"
 #include "util.h"
 
+#include "julia.h"
+#include "pixel.h"
+#include "pool.h"
+#include "raster.h"
 #include "sdlplot.h"
+#include "text.h"
 
 FT_Library library;
 FT_Face text_face;
 FT_Face audio_face;
+// glyphs of both faces, rendered, and strings laid out
+static struct text_cache text_cache;
+
+// render threads, and the scratch buffer of the blur
+struct pool render_pool;
+buffer blur_scratch;
+// the progressive Julia renderer's state, for the size of buffer it last drew
+static struct julia julia_state;
 
 
 uint32_t rgba_to_pixel(rgba c) {
@@ -62,71 +75,92 @@ void freetype_init(char *text_font, char *audio_font) {
 } 
 
 void freetype_cleanup() {
+    // the faces' glyphs go with them
+    text_free(&text_cache);
     FT_Done_Face(text_face);
     FT_Done_Face(audio_face);
     FT_Done_FreeType(library);
 }
 
+void bf_threads_init(int threads) {
+    pool_init(&render_pool, threads);
+}
+
+void bf_threads_cleanup() {
+    pool_free(&render_pool);
+    bf_free_pixels(&blur_scratch);
+    blur_scratch.size = 0;
+    julia_free(&julia_state);
+    memset(&julia_state, 0, sizeof(julia_state));
+}
+
 uint8_t clamp(double c) {
     // prevent overflow
     return (uint8_t)min(255, max(0, c));
 }
 
+rgba tinge_color(rgba c1, rgba c2, double persistence) {
+    // c1 faded into c2, persistence*c1 + (1-persistence)*c2
+    uint32_t p = rgba_to_pixel(c1);
+    px_tinge_ref(&p, 1, rgba_to_pixel(c2), px_factor(persistence));
+    return pixel_to_rgba(p);
+}
+
+void bf_damage(const buffer buff, long x0, long y0, long x1, long y1) {
+    // mark x0 <= x < x1, y0 <= y < y1 as changed, as far as it is in the buffer
+    x0 = max(x0, 0L);
+    y0 = max(y0, 0L);
+    x1 = min(x1, (long)buff.w);
+    y1 = min(y1, (long)buff.h);
+    if (x0 < x1 && y0 < y1) {
+        SDL_Rect r = {(int)x0, (int)y0, (int)(x1 - x0), (int)(y1 - y0)};
+        damage_add(buff.damage, r);
+    }
+}
+
+void bf_damage_all(const buffer buff) {
+    bf_damage(buff, 0, 0, buff.w, buff.h);
+}
+
+static void bf_damage_rect(const buffer buff, SDL_Rect r) {
+    bf_damage(buff, r.x, r.y, (long)r.x + r.w, (long)r.y + r.h);
+}
+
+static void bf_damage_extent(const buffer buff) {
+    // an operation on every pixel changes only those that aren't 0
+    if (buff.damage) {
+        bf_damage_rect(buff, buff.damage->extent);
+    }
+}
+
 void bf_blend(const buffer buff1, const buffer buff2, double persistence) {
     // fade b2 into b1, of same size
     // b1 = persistence*b1 + (1-persistence)*b2
-    register double r1, g1, b1, a1;
-    register double r2, g2, b2, a2;
-    register pixel p;
-    for (uint32_t i = 0; i < buff1.size; i++) {
-        // separate channels
-        p = buff1.pixels[i];
-        r1 = ((p >> 24) & 0xFF) * persistence;
-        g1 = ((p >> 16) & 0xFF) * persistence;
-        b1 = ((p >> 8) & 0xFF) * persistence;
-        a1 = ((p >> 0) & 0xFF) * persistence;
-        p = buff2.pixels[i];
-        r2 = ((p >> 24) & 0xFF) * (1.0 - persistence);
-        g2 = ((p >> 16) & 0xFF) * (1.0 - persistence);
-        b2 = ((p >> 8) & 0xFF) * (1.0 - persistence);
-        a2 = ((p >> 0) & 0xFF) * (1.0 - persistence);
-        // blend
-        p = ((int)r1 << 24)    |
-            ((int)g1 << 16)    |
-            ((int)b1 << 8)     |
-            ((int)a1 << 0);
-        p += ((int)r2 << 24)   |
-             ((int)g2 << 16)   |
-             ((int)b2 << 8)    |
-             ((int)a2 << 0);
-        // put back
-        buff1.pixels[i] = p;
+    bf_damage_extent(buff1);
+    if (buff2.damage) {
+        bf_damage_rect(buff1, buff2.damage->extent);
     }
+    px_blend(buff1.pixels, buff2.pixels, min(buff1.size, buff2.size), px_factor(persistence));
 }
 
 void bf_shade(const buffer buff, double persistence) {
     // shade buffer into black (persistence < 1.0) or brighter (persistence > 1.0)
     // buff = persistence*buff
-    register int r, g, b, a;
-    register pixel p;
-    for (uint32_t i = 0; i < buff.size; i++) {
-        // separate channels
-        p = buff.pixels[i];
-        r = (p >> 24) & 0xFF;
-        g = (p >> 16) & 0xFF;
-        b = (p >> 8) & 0xFF;
-        a = (p >> 0) & 0xFF;
-        // blend
-        r = (int)(persistence * r);
-        g = (int)(persistence * g);
-        b = (int)(persistence * b);
-        a = (int)(persistence * a);
-        p = (r << 24)    |
-            (g << 16)  |
-            (b << 8)   |
-            (a << 0);
-        buff.pixels[i] = p;
-    }
+    bf_damage_extent(buff);
+    px_shade(buff.pixels, buff.size, px_factor(persistence));
+}
+
+void bf_tinge(const buffer buff, const rgba tint_color, double persistence) {
+    // fade buffer into a colour
+    // buff = persistence*buff + (1-persistence)*tint_color
+    bf_damage_all(buff);
+    px_tinge(buff.pixels, buff.size, rgba_to_pixel(tint_color), px_factor(persistence));
+}
+
+void bf_grayscale(const buffer buff) {
+    // replace colour by its luma
+    bf_damage_extent(buff);
+    px_grayscale(buff.pixels, buff.size);
 }
 
 void bf_init(buffer *buff, int w, int h) {
@@ -136,142 +170,181 @@ void bf_init(buffer *buff, int w, int h) {
     buff->size = buff->h * buff->w;
     debug("allocating new buffer pixels\n");
     buff->pixels = (pixel*)calloc(buff->size, sizeof(pixel));
+    buff->damage = (damage*)calloc(1, sizeof(damage));
 }
 
 void bf_free_pixels(buffer *buff) {
     free(buff->pixels);
+    free(buff->damage);
+    buff->damage = NULL;
 }
 
 void bf_set_pixel(buffer buff, uint32_t x, uint32_t y, rgba c) {
-    debug("i: %d\n", x * buff.h + y);
-    buff.pixels[(y % (uint32_t)buff.h) * buff.w + (x % (uint32_t)buff.w)] = rgba_to_pixel(c);
+    // a pixel outside the buffer is dropped; primitives that draw many use raster.h
+    if (raster_inside(buff, x, y)) {
+        raster_put(buff, x, y, rgba_to_pixel(c));
+        bf_damage(buff, x, y, x + 1, y + 1);
+    }
 }
 
 rgba bf_get_pixel(buffer buff, uint32_t x, uint32_t y) {
-    debug("i: %d\n", x * buff.h + y);
-    return pixel_to_rgba(buff.pixels[(y % (uint32_t)buff.h) * buff.w + (x % (uint32_t)buff.w)]);
+    // outside the buffer is transparent
+    rgba none = {0};
+    return raster_inside(buff, x, y) ? pixel_to_rgba(*raster_at(buff, x, y)) : none;
 }
 
 void bf_clear(const buffer buff) {
-    memset(buff.pixels, 0, sizeof(pixel) * buff.size);
+    // only what was drawn since the last clear needs clearing
+    if (buff.damage) {
+        SDL_Rect e = buff.damage->extent;
+        bf_damage_rect(buff, e);
+        for (int y = e.y; y < e.y + e.h; y++) {
+            memset(buff.pixels + (size_t)y * buff.w + e.x, 0, sizeof(pixel) * e.w);
+        }
+        SDL_Rect none = {0};
+        buff.damage->extent = none;
+    } else {
+        memset(buff.pixels, 0, sizeof(pixel) * buff.size);
+    }
 }
 
 void bf_fill(const buffer buff, const rgba c) {
-    // FIXME: write with stride of every fourth byte
-    memset(buff.pixels, rgba_to_pixel(c), sizeof(pixel) * buff.size);
+    bf_damage_all(buff);
+    pixel p = rgba_to_pixel(c);
+    for (uint32_t y = 0; y < buff.h; y++) {
+        raster_hspan(buff, 0, buff.w, y, p);
+    }
 }
 
 void bf_copy(const buffer buff1, const buffer buff2) {
-    // copy buff2 into buff1
+    // copy buff2 into buff1, of the same size
+    // only rows that differ are changed, so copying an unchanged frame is no damage
+    if (buff1.damage && buff2.damage && buff1.w == buff2.w && buff1.h == buff2.h) {
+        // the union of the extents; outside it both are 0
+        damage u = *buff1.damage;
+        damage_add(&u, buff2.damage->extent);
+        SDL_Rect e = u.extent;
+        long run = -1;
+        for (int y = e.y; y <= e.y + e.h; y++) {
+            size_t i = (size_t)y * buff1.w + e.x;
+            bool differ = y < e.y + e.h && memcmp(buff1.pixels + i, buff2.pixels + i, sizeof(pixel) * e.w);
+            if (differ && run < 0) {
+                run = y;
+            } else if (!differ && run >= 0) {
+                bf_damage(buff1, e.x, run, (long)e.x + e.w, y);
+                run = -1;
+            }
+        }
+        buff1.damage->extent = buff2.damage->extent;
+    } else {
+        bf_damage_all(buff1);
+    }
     memcpy(buff1.pixels, buff2.pixels, sizeof(pixel) * ((buff1.size < buff2.size) ? buff1.size : buff2.size));
 }
 
 void bf_superpose(const buffer buff1, const buffer buff2) {
     // superpose buff2 over buff1 where buff2 is not 0
-    for (uint32_t i = 0; i < buff1.size; i++) {
-        if (buff2.pixels[i]) {
-            buff1.pixels[i] = buff2.pixels[i];
-        }
-    }
-}
-
-void bf_blur(const buffer buff) {
-    // ghetto blur
-    for (uint32_t x1=1; x1 < buff.w - 1; x1++) {
-        for (uint32_t y1=1; y1 < buff.h - 1; y1++) {
-            uint32_t x2 = x1 + rand()%3 - 1;
-            uint32_t y2 = y1 + rand()%3 - 1;
-            rgba c1 = bf_get_pixel(buff, x1, y1);
-            rgba c2 = bf_get_pixel(buff, x2, y2);
-            rgba c3 = {
-                c1.r/2 + c2.r/2,
-                c1.g/2 + c2.g/2,
-                c1.b/2 + c2.b/2,
-                c1.a
-            };
-            bf_set_pixel(buff, x1, y1, c3);
-            bf_set_pixel(buff, x2, y2, c3);
-        }
+    if (buff2.damage) {
+        bf_damage_rect(buff1, buff2.damage->extent);
+    } else {
+        bf_damage_all(buff1);
     }
+    px_superpose(buff1.pixels, buff2.pixels, min(buff1.size, buff2.size));
 }
 
-void bf_text(buffer buff, char *text, int num_chars, int size, int center, uint32_t x, uint32_t y, int style, rgba c) {
-    // Write text to buff.
-    int w = 0;
-    int pen_x = 0;
-    int width = 0;
-    //int pen_y;
-    int n, error;
-    rgba c_text = c;
-
-    FT_Face face;
-
-    if (style) {
-        face = text_face;
-    } else {
-        face = audio_face;
-    }
+struct blur_task {
+    buffer src, dst;
+    int radius;
+};
 
-    error = FT_Set_Char_Size(
-            face,               /* handle to face object           */
-            0,                  /* char_width in 1/64th of points  */
-            size*64,            /* char_height in 1/64th of points */
-            DPI,                /* horizontal device resolution    */
-            DPI);               /* vertical device resolution      */
+static void bf_blur_rows(void *arg, int job) {
+    struct blur_task *t = arg;
+    uint32_t first = job * STRIPE_ROWS;
+    px_box_rows(t->src.pixels, t->dst.pixels, t->src.w, first, min(first + STRIPE_ROWS, t->src.h), t->radius);
+}
 
-    FT_GlyphSlot slot = face->glyph;
+static void bf_blur_columns(void *arg, int job) {
+    struct blur_task *t = arg;
+    uint32_t first = job * STRIPE_ROWS;
+    px_box_columns(t->src.pixels, t->dst.pixels, t->src.w, t->src.h, first, min(first + STRIPE_ROWS, t->src.h), t->radius);
+}
 
-    // get extent of the rendered text
-    for (n = 0; n < num_chars; n++) {
-        // Load glyph image into the slot (erasing previous one).
-        // We do this again in a minute, but they should be cached anyway.
-        error = FT_Load_Char(face, text[n], FT_LOAD_RENDER);
-        if (error)
-            continue;  /* ignore errors */
-        width += slot->advance.x >> 6;
+void bf_blur(const buffer buff, int radius, int passes) {
+    // separable box blur, 2*radius + 1 pixels square, in stripes across the render threads
+    // passes > 1 repeat it, and three passes are close to a Gaussian
+    radius = min(radius, PX_BLUR_RADIUS_MAX);
+    if (radius < 1 || buff.size == 0)
+        return;
+    if (blur_scratch.w != buff.w || blur_scratch.h != buff.h) {
+        bf_free_pixels(&blur_scratch);
+        bf_init(&blur_scratch, buff.w, buff.h);
+    }
+    // the rows go to the scratch buffer and come back down the columns, so no stripe
+    // reads rows another is writing
+    struct blur_task along = {buff, blur_scratch, radius};
+    struct blur_task down = {blur_scratch, buff, radius};
+    int stripes = (buff.h + STRIPE_ROWS - 1) / STRIPE_ROWS;
+    for (int n = 0; n < passes; n++) {
+        pool_run(&render_pool, bf_blur_rows, &along, stripes);
+        pool_run(&render_pool, bf_blur_columns, &down, stripes);
+    }
+    // each pass spreads what isn't 0 by the radius
+    if (buff.damage) {
+        SDL_Rect e = buff.damage->extent;
+        long spread = (long)radius * passes;
+        bf_damage(buff, e.x - spread, e.y - spread, e.x + e.w + spread, e.y + e.h + spread);
     }
+}
+
+void bf_text(buffer buff, char *text, int num_chars, int size, int center, uint32_t x, uint32_t y, int style, rgba c) {
+    // Write text to buff, blending glyphs from the atlas by their coverage.
+    FT_Face face = style ? text_face : audio_face;
+    const struct layout *l = text_layout(&text_cache, face, size, DPI, text, num_chars);
     if (center)
-        x = buff.w / 2 - (uint32_t)(width / 2);
-
-    for (n = 0; n < num_chars; n++) {
-        /* load glyph image into the slot (erase previous one) */
-        error = FT_Load_Char(face, text[n], FT_LOAD_RENDER);
-        if (error)
-            continue;  /* ignore errors */
-
-        for (uint32_t dx=0; dx < slot->bitmap.width; dx++) {
-            for (uint32_t dy=0; dy < slot->bitmap.rows; dy++) {
-                // use grayscale hinting because text may be any colour
-                w = slot->bitmap.buffer[dy * slot->bitmap.pitch + dx];
-                c_text.r = (uint8_t)(c.r * w >> 8);
-                c_text.g = (uint8_t)(c.g * w >> 8);
-                c_text.b = (uint8_t)(c.b * w >> 8);
-                if (w != 0) {
-                    // render to temp buffer
-                    bf_set_pixel(buff,
-                            x + dx + (uint32_t)pen_x,
-                            y + (uint32_t)(slot->bitmap_top) - dy,
-                            c_text);
-                }
-            }
+        x = buff.w / 2 - (uint32_t)(l->width / 2);
+
+    uint32_t colour = rgba_to_pixel(c);
+    raster_box extent = raster_none();
+    for (int n = 0; n < l->n; n++) {
+        const struct glyph *g = &text_cache.glyph[l->glyph[n]];
+        // the glyph on screen, clipped; y is up the buffer, so the glyph's top row is its
+        // highest, and row dy of the glyph is row y + top - dy
+        long gx = (long)x + l->pen[n];
+        long top = (long)y + g->top;
+        raster_box b = raster_clip(buff, gx, top - g->h + 1, gx + g->w, top + 1);
+        if (raster_empty(b))
+            continue;
+        for (long row = b.y0; row < b.y1; row++) {
+            px_cover(raster_at(buff, b.x0, row), text_row(&text_cache, g, top - row) + (b.x0 - gx), b.x1 - b.x0, colour);
         }
-
-        /* increment pen position */
-        pen_x += slot->advance.x >> 6;
+        raster_extend(&extent, b.x0, b.y0);
+        raster_extend(&extent, b.x1 - 1, b.y1 - 1);
     }
+    bf_damage(buff, extent.x0, extent.y0, extent.x1, extent.y1);
 }
 
 void bf_draw_line(const buffer buff, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, rgba c) {
     // draw a line to the buffer
     // look at Bresenham's algorithm, or even antialiasing
-    register int x, y;
-    register int dx = x1 - x0;
-    register int dy = y1 - y0;
-    register int l = dx > dy ? dx : dy;
-    for (register int i = 0; i <= l; i++) {
-        x = x0 + i * dx / l;
-        y = y0 + i * dy / l;
-        bf_set_pixel(buff, x, y, c);
+    pixel p = rgba_to_pixel(c);
+    long dx = (long)x1 - x0;
+    long dy = (long)y1 - y0;
+    raster_box b = raster_clip(buff, min(x0, x1), min(y0, y1), (long)max(x0, x1) + 1, (long)max(y0, y1) + 1);
+    if (raster_empty(b))
+        return;
+    bf_damage(buff, b.x0, b.y0, b.x1, b.y1);
+    // ticks and axes are spans of the clipped extent
+    if (dy == 0) {
+        raster_hspan(buff, b.x0, b.x1, y0, p);
+        return;
+    }
+    if (dx == 0) {
+        raster_vspan(buff, x0, b.y0, b.y1, p);
+        return;
+    }
+    long l = max(labs(dx), labs(dy));
+    for (long i = 0; i <= l; i++) {
+        raster_plot(buff, &b, x0 + i * dx / l, y0 + i * dy / l, p);
     }
 }
 
@@ -283,6 +356,14 @@ void bf_draw_arc(const buffer buff, int x0, int y0, int radius, double theta0, d
     c2.r /= 2;
     c2.g /= 2;
     c2.b /= 2;
+    pixel p = rgba_to_pixel(c);
+    pixel p2 = rgba_to_pixel(c2);
+    // the upper half of the circle, and the smoothed edges around it
+    long outer = radius + thickness + 1;
+    raster_box b = raster_clip(buff, (long)x0 - outer, (long)y0 - 1, (long)x0 + outer + 1, (long)y0 + outer + 1);
+    if (raster_empty(b))
+        return;
+    bf_damage(buff, b.x0, b.y0, b.x1, b.y1);
     // sweep over all x1 < x < x2 and find y
     // smooth the edges
     r = radius;
@@ -290,16 +371,16 @@ void bf_draw_arc(const buffer buff, int x0, int y0, int radius, double theta0, d
     xmax = x0 + (int)(r * cos(theta1 * 2 * M_PI / 360));
     for (x = (int)xmin; x <= (int)xmax; x++) {
         y = y0 + sqrt(r * r - (x - x0) * (x - x0));
-        bf_set_pixel(buff, (uint32_t)(x + 1), (uint32_t)(y - 1), c2);
-        bf_set_pixel(buff, (uint32_t)(x - 1), (uint32_t)(y - 1), c2);
+        raster_plot(buff, &b, x + 1, y - 1, p2);
+        raster_plot(buff, &b, x - 1, y - 1, p2);
     }
     r = radius + thickness;
     xmin = x0 + (int)(r * cos(theta0 * 2 * M_PI / 360));
     xmax = x0 + (int)(r * cos(theta1 * 2 * M_PI / 360));
     for (x = (int)xmin; x <= (int)xmax; x++) {
         y = y0 + sqrt(r * r - (x - x0) * (x - x0));
-        bf_set_pixel(buff, (uint32_t)(x + 1), (uint32_t)(y + 1), c2);
-        bf_set_pixel(buff, (uint32_t)(x - 1), (uint32_t)(y + 1), c2);
+        raster_plot(buff, &b, x + 1, y + 1, p2);
+        raster_plot(buff, &b, x - 1, y + 1, p2);
     }
     // for those x, y, paint the pixels
     for (r = radius; r <= radius + thickness; r++) {
@@ -307,9 +388,9 @@ void bf_draw_arc(const buffer buff, int x0, int y0, int radius, double theta0, d
         xmax = x0 + (int)(r * cos(theta1 * 2 * M_PI / 360));
         for (x = (int)xmin; x <= (int)xmax; x++) {
             y = y0 + sqrt(r * r - (x - x0) * (x - x0));
-            bf_set_pixel(buff, (uint32_t)x, (uint32_t)y, c);
-            bf_set_pixel(buff, (uint32_t)x, (uint32_t)(y + 1), c);
-            bf_set_pixel(buff, (uint32_t)x, (uint32_t)(y - 1), c);
+            if (x >= b.x0 && x < b.x1) {
+                raster_vspan(buff, x, max(y - 1L, b.y0), min(y + 2L, b.y1), p);
+            }
         }
     }
 }
@@ -322,20 +403,31 @@ void bf_draw_ray(const buffer buff, int x0, int y0, int r0, int r1, double theta
     c2.r /= 2;
     c2.g /= 2;
     c2.b /= 2;
+    pixel p = rgba_to_pixel(c);
+    pixel p2 = rgba_to_pixel(c2);
+    double cos_theta = cos(theta * 2 * M_PI / 360);
+    double sin_theta = sin(theta * 2 * M_PI / 360);
+    // the ray runs straight from one end to the other, thickness wide and a pixel either side
+    int xa = x0 + (int)(r0 * cos_theta), xb = x0 + (int)(r1 * cos_theta);
+    int ya = y0 + (int)(r0 * sin_theta), yb = y0 + (int)(r1 * sin_theta);
+    raster_box b = raster_clip(buff, min(xa, xb), min(ya, yb) - 1L, max(xa, xb) + (long)max(thickness, 1), max(ya, yb) + 2L);
+    if (raster_empty(b))
+        return;
+    bf_damage(buff, b.x0, b.y0, b.x1, b.y1);
     // for those x, y, paint the pixels
     for (r = r0; r <= r1; r++) {
         for (dx = 0; dx < thickness; dx++) {
-            x = dx + x0 + (int)(r * cos(theta * 2 * M_PI / 360));
-            y = y0 + (int)(r * sin(theta * 2 * M_PI / 360));
-            bf_set_pixel(buff, (uint32_t)x, (uint32_t)(y - 1), c2);
-            bf_set_pixel(buff, (uint32_t)x, (uint32_t)(y + 1), c2);
+            x = dx + x0 + (int)(r * cos_theta);
+            y = y0 + (int)(r * sin_theta);
+            raster_plot(buff, &b, x, y - 1, p2);
+            raster_plot(buff, &b, x, y + 1, p2);
         }
     }
     for (r = r0; r <= r1; r++) {
         for (dx = 0; dx < thickness; dx++) {
-            x = dx + x0 + (int)(r * cos(theta * 2 * M_PI / 360));
-            y = y0 + (int)(r * sin(theta * 2 * M_PI / 360));
-            bf_set_pixel(buff, (uint32_t)x, (uint32_t)y, c);
+            x = dx + x0 + (int)(r * cos_theta);
+            y = y0 + (int)(r * sin_theta);
+            raster_plot(buff, &b, x, y, p);
         }
     }
 }
@@ -350,8 +442,12 @@ void bf_xtick(const buffer buff, const axes ax, double x, const rgba c) {
     bf_draw_line(buff, screen_x, ax.screen_y, screen_x, ax.screen_y + TICK_SIZE, c);
 }
 
+uint32_t bf_ytick_y(const axes ax, double y) {
+    return ax.screen_h * (y - ax.y_min) / (ax.y_max - ax.y_min) + ax.screen_y;
+}
+
 void bf_ytick(const buffer buff, const axes ax, double y, const rgba c) {
-    uint32_t screen_y = ax.screen_h * (y - ax.y_min) / (ax.y_max - ax.y_min) + ax.screen_y;
+    uint32_t screen_y = bf_ytick_y(ax, y);
     bf_draw_line(buff, ax.screen_x, screen_y, ax.screen_x + TICK_SIZE, screen_y, c);
 }
 
@@ -389,46 +485,62 @@ void bf_plot_axes(const buffer buff, const axes ax, const rgba c1, const rgba c2
     bf_xtick(buff, ax2, log10(440 * 32), c2);
 }
 
-void bf_plot_bars(const buffer buff, const axes ax, const int data[], uint32_t num_points, rgba c) {
-    // plot some data to the buffer
+// a point of a trace, whose extent can't be known before it is plotted: dropped outside
+// the buffer, and kept in extent for the damage
+static inline void bf_trace(const buffer buff, raster_box *extent, long x, long y, pixel p) {
+    if (raster_inside(buff, x, y)) {
+        raster_put(buff, x, y, p);
+        raster_extend(extent, x, y);
+    }
+}
+
+void bf_plot_bars(const buffer buff, const axes ax, const sample_t data[], uint32_t num_points, rgba c) {
+    // plot some data, in dB, to the buffer
     register uint32_t x, y, dy;
     register uint8_t r, g, b, a;
     register pixel p;
+    raster_box extent = raster_none();
     for (uint32_t i=0; i < num_points; i++) {
-        y = (uint32_t)(ax.screen_h * (10 * log10(data[i]) - ax.y_min) / (ax.y_max - ax.y_min)) + ax.screen_y;
+        y = (uint32_t)(ax.screen_h * (data[i] - ax.y_min) / (ax.y_max - ax.y_min)) + ax.screen_y;
+        x = (uint32_t)((ax.screen_w * i) / num_points) + ax.screen_x;
         // y can overflow, so check bounds
-        if (y > ax.screen_y && y < buff.h) {
-            x = (uint32_t)((ax.screen_w * i) / num_points) + ax.screen_x;
+        if (y > ax.screen_y && y < buff.h && x < buff.w) {
             // draw peaks
-            bf_set_pixel(buff, x,   y,   c);
+            raster_put(buff, x, y, rgba_to_pixel(c));
             // draw faded lines up to y
-            // raw pixels for speed
-            for (dy = ax.screen_y; dy < y; dy++) {
+            pixel *q = raster_at(buff, x, ax.screen_y);
+            for (dy = ax.screen_y; dy < y; dy++, q += buff.w) {
                 r = (c.r * (dy - ax.screen_y) / ax.screen_h);
                 g = (c.g * (dy - ax.screen_y) / ax.screen_h);
                 b = (c.b * (dy - ax.screen_y) / ax.screen_h);
                 a = (c.a * (dy - ax.screen_y) / ax.screen_h);
-                p = (r << 24) |
-                    (g << 16) |
-                    (b << 8) |
-                    (a << 0);
-                buff.pixels[(dy % (uint32_t)buff.h) * buff.w + (x % (uint32_t)buff.w)] = p;
+                p = ((pixel)r << 24) |
+                    ((pixel)g << 16) |
+                    ((pixel)b << 8) |
+                    ((pixel)a << 0);
+                *q = p;
             }
+            raster_extend(&extent, x, ax.screen_y);
+            raster_extend(&extent, x, y);
         }
     }
+    bf_damage(buff, extent.x0, extent.y0, extent.x1, extent.y1);
 }
 
-void bf_plot_line(const buffer buff, const axes ax, const double data[], uint32_t num_points, rgba c) {
+void bf_plot_line(const buffer buff, const axes ax, const sample_t data[], uint32_t num_points, rgba c) {
     // plot some data to the buffer, cartesian plot
     register uint32_t x, y;
+    pixel p = rgba_to_pixel(c);
+    raster_box extent = raster_none();
     for (uint32_t i=1; i < num_points; i++) {
         x = (uint32_t)((ax.screen_w * i) / num_points) + ax.screen_x;
         y = (uint32_t)((ax.screen_h * (data[i] - ax.y_min)) / (ax.y_max - ax.y_min)) + ax.screen_y;
-        bf_set_pixel(buff, x, y, c);
+        bf_trace(buff, &extent, x, y, p);
     }
+    bf_damage(buff, extent.x0, extent.y0, extent.x1, extent.y1);
 }
 
-void bf_plot_polar(const buffer buff, const axes ax, const double data[], uint32_t num_points, rgba c) {
+void bf_plot_polar(const buffer buff, const axes ax, const sample_t data[], uint32_t num_points, rgba c) {
     // plot some data to the buffer, polar plot
 
     register uint32_t x0 = ax.screen_w / 2;
@@ -436,16 +548,19 @@ void bf_plot_polar(const buffer buff, const axes ax, const double data[], uint32
     register uint32_t x, y;
     register double theta, r;
     register double r0 = fmin(x0, y0);
+    pixel p = rgba_to_pixel(c);
+    raster_box extent = raster_none();
     for (uint32_t i=0; i < num_points; i++) {
         theta = 2.0 * M_PI * i / num_points;
         r = r0 * (0.5 + data[i] / 2 / 65536.0);
         x = (uint32_t)(r * cos(theta) + x0);
         y = (uint32_t)(r * sin(theta) + y0);
-        bf_set_pixel(buff, x, y,   c);
+        bf_trace(buff, &extent, x, y, p);
     }
+    bf_damage(buff, extent.x0, extent.y0, extent.x1, extent.y1);
 }
 
-void bf_plot_osc(const buffer buff, const axes ax, const double data_x[], const double data_y[], uint32_t num_points, rgba c) {
+void bf_plot_osc(const buffer buff, const axes ax, const sample_t data_x[], const sample_t data_y[], uint32_t num_points, rgba c) {
     // plot some data to the buffer like an oscilloscope
 
     // model afterimage with complementary colour
@@ -455,6 +570,9 @@ void bf_plot_osc(const buffer buff, const axes ax, const double data_x[], const
         c.r/4 + c.g/4,
         c.a
     };
+    pixel p = rgba_to_pixel(c);
+    pixel p_afterimage = rgba_to_pixel(c_afterimage);
+    raster_box extent = raster_none();
 
     register double h = fmin(ax.screen_w, ax.screen_h);
     register double range = ax.y_max - ax.y_min;
@@ -469,63 +587,103 @@ void bf_plot_osc(const buffer buff, const axes ax, const double data_x[], const
         x = (uint32_t)(h * (data_x[i] - ax.y_min) / range) + ax.screen_x + dx;
         y = (uint32_t)(h * (data_y[i] - ax.y_min) / range) + ax.screen_y + dy;
 
-        bf_set_pixel(buff, x+1, y, c_afterimage);
-        bf_set_pixel(buff, x-1, y, c_afterimage);
-        bf_set_pixel(buff, x, y+1, c_afterimage);
-        bf_set_pixel(buff, x, y-1, c_afterimage);
+        bf_trace(buff, &extent, x+1L, y, p_afterimage);
+        bf_trace(buff, &extent, x-1L, y, p_afterimage);
+        bf_trace(buff, &extent, x, y+1L, p_afterimage);
+        bf_trace(buff, &extent, x, y-1L, p_afterimage);
     }
 
     // draw the new image
     for (uint32_t i=0; i < num_points - 1; i++) {
         x = (uint32_t)(h * (data_x[i] - ax.y_min) / range) + ax.screen_x + dx;
         y = (uint32_t)(h * (data_y[i] - ax.y_min) / range) + ax.screen_y + dy;
-        bf_set_pixel(buff, x, y, c);
+        bf_trace(buff, &extent, x, y, p);
     }
+    bf_damage(buff, extent.x0, extent.y0, extent.x1, extent.y1);
 
 }
 
-void bf_plot_julia(const buffer buff, double cx, double cy, rgba col) {
-    // plot a Julia set
-    // I'm amazed how fast this is
+struct julia_task {
+    buffer buff;
+    const struct julia *j;
+    int columns, rows;          // the part computed
+    const pixel *lut;
+};
+
+static void bf_julia_tile(void *arg, int job) {
+    const struct julia_task *t = arg;
+    const struct julia *j = t->j;
+    int x_first = (job % j->tiles_x) * JULIA_TILE;
+    int y_first = (job / j->tiles_x) * JULIA_TILE;
+    int x_last = min(x_first + JULIA_TILE, t->columns);
+    for (int y = y_first; y < min(y_first + JULIA_TILE, t->rows); y++) {
+        const int16_t *count = j->count + (size_t)y * j->pw;
+        pixel *row = t->buff.pixels + (size_t)y * t->buff.w;
+        // the point reflected through z = 0 takes the same count
+        int y_mirror = 2 * j->y0 - y;
+        pixel *row_mirror = (y < j->y0 && y_mirror < (int)t->buff.h) ? t->buff.pixels + (size_t)y_mirror * t->buff.w : NULL;
+        for (int x = x_first; x < x_last; x++) {
+            // points in the set leave the fading trail
+            if (count[x] == JULIA_ITERATIONS)
+                continue;
+            int x_mirror = 2 * j->x0 - x;
+            if (x < (int)t->buff.w)
+                row[x] = t->lut[count[x]];
+            if (row_mirror && x_mirror >= 0 && x_mirror < (int)t->buff.w)
+                row_mirror[x_mirror] = t->lut[count[x]];
+        }
+    }
+}
+
+void bf_plot_julia(const buffer buff, double cx, double cy, rgba col, int quality, double frame_ms) {
+    // plot a Julia set, progressively, in tiles across the render threads
 
     // choose R > 0 such that R^n - R >= sqrt(cx^2 + cy^2)
     double R = 1e-4 + 0.5 + sqrt(1 + 4 * (cx*cx + cy*cy));
-
     uint32_t l = (buff.w < buff.h) ? buff.w : buff.h;
-    register double zx, zy, temp;
-
-    for (int x=0; x<(int)buff.w; x++) {
-        for (int y=0; y<(int)buff.h; y++) {
-            // maybe add a zoom feature
-            zx = 0.7 * 2 * R * (x - (int)buff.w/2) / l;
-            zy = 0.7 * 2 * R * (y - (int)buff.h/2) / l;
-
-            int iteration = 0;
-            int max_iteration = 120;
-
-            while (((zx * zx + zy * zy) < (R * R)) && (iteration < max_iteration)) {
-                temp = zx * zx - zy * zy;
-                zy = 2 * zx * zy  + cy;
-                zx = temp + cx;
-                iteration++;
-            } 
-            if (iteration < max_iteration) {
-                rgba shade = {
-                    // deliberate overflow
-                    (uint32_t)(((col.g + col.b) * iteration) / max_iteration),
-                    (uint32_t)(((col.r + col.b) * iteration) / max_iteration),
-                    (uint32_t)(((col.r + col.g) * iteration) / max_iteration),
-                    col.a
-                };
-                bf_set_pixel(buff, x, y, shade);
+
+    // colour by iteration count
+    static pixel lut[JULIA_ITERATIONS];
+    static pixel lut_col = 0;
+    static bool lut_valid = false;
+    if (!lut_valid || lut_col != rgba_to_pixel(col)) {
+        for (int n = 0; n < JULIA_ITERATIONS; n++) {
+            rgba shade = {
+                // deliberate overflow
+                (uint8_t)(((col.g + col.b) * n) / JULIA_ITERATIONS),
+                (uint8_t)(((col.r + col.b) * n) / JULIA_ITERATIONS),
+                (uint8_t)(((col.r + col.g) * n) / JULIA_ITERATIONS),
+                col.a
             };
+            lut[n] = rgba_to_pixel(shade);
         }
+        lut_col = rgba_to_pixel(col);
+        lut_valid = true;
+    }
+
+    if (julia_state.w != (int)buff.w || julia_state.h != (int)buff.h) {
+        julia_free(&julia_state);
+        julia_init(&julia_state, buff.w, buff.h);
     }
+    // maybe add a zoom feature
+    julia_frame(&julia_state, &render_pool, cx, cy, R * R, 0.7 * 2 * R / l, quality, frame_ms);
+
+    // Julia sets are symmetric under z -> -z, so only the rows down to z = 0 are computed,
+    // and reflected through it; they run out to the column that reflects onto column 0
+    struct julia_task t = {
+        .buff = buff,
+        .j = &julia_state,
+        .columns = max((int)buff.w, 2 * julia_state.x0 + 1),
+        .rows = julia_state.y0 + 1,
+        .lut = lut,
+    };
+    pool_run(&render_pool, bf_julia_tile, &t, julia_state.tiles_x * julia_state.tiles_y);
+    bf_damage_all(buff);
 }
 
-void bf_blit(buffer buff, int frame_time, int rotate) {
-    // blit buffer pixels to the SDL texture
+void bf_blit(layer layers[LAYERS], int frame_time, int rotate) {
+    // blit the layers' pixels to their SDL textures, and composite them
     // relies on pixel format being the same
-    sdl_blit(buff, frame_time, rotate);
+    sdl_blit(layers, frame_time, rotate);
 }
 
@@ -11,6 +11,7 @@
 #include <inttypes.h>
 
 #include "render.h"
+#include "util.h"
 
 #ifndef M_PI
 #define M_PI 3.1415926535897932385
@@ -18,6 +19,8 @@
 
 #define DPI 231
 #define TICK_SIZE 3
+// rows per job of the whole-buffer operations run across the render threads
+#define STRIPE_ROWS 32
 
 
 typedef struct {
@@ -43,12 +46,19 @@ rgba tinge_color(rgba c1, rgba c2, double persistence);
 void freetype_init(char *text_font, char*audio_font);
 void freetype_cleanup();
 
+void bf_threads_init(int threads);
+void bf_threads_cleanup();
+
 void bf_init(buffer *buff, int w, int h);
 void bf_free_pixels(buffer *buff);
 
+// mark a part, or all, of buff as changed, for pixels written other than by bf_ functions
+void bf_damage(const buffer buff, long x0, long y0, long x1, long y1);
+void bf_damage_all(const buffer buff);
+
 void bf_set_pixel(buffer buff, uint32_t x, uint32_t y, rgba c);
 
-void bf_blit(buffer buff, int frame_time, int rotate);
+void bf_blit(layer layers[LAYERS], int frame_time, int rotate);
 
 void bf_render(buffer buff);
 
@@ -68,7 +78,7 @@ void bf_tinge(const buffer buff, const rgba tint_color, double persistence);
 
 void bf_superpose(const buffer buff1, const buffer buff2);
 
-void bf_blur(const buffer buff);
+void bf_blur(const buffer buff, int radius, int passes);
 
 void bf_grayscale(const buffer buff);
 
@@ -84,11 +94,13 @@ void bf_ray_xy(int x0, int y0, int radius, double theta, int *x, int *y);
 
 void bf_xtick(const buffer buff, const axes ax, double x, const rgba c);
 void bf_ytick(const buffer buff, const axes ax, double y, const rgba c);
+// the row of the tick at y
+uint32_t bf_ytick_y(const axes ax, double y);
 
 void bf_plot_axes(const buffer buff, const axes ax, const rgba c1, const rgba c2);
 
-void bf_plot_bars(const buffer buff, const axes ax, const int data[], uint32_t num_points, rgba c);
-void bf_plot_line(const buffer buff, const axes ax, const double data[], uint32_t num_points, rgba c);
-void bf_plot_polar(const buffer buff, const axes ax, const double data[], uint32_t num_points, rgba c);
-void bf_plot_osc(const buffer buff, const axes ax, const double data_x[], const double data_y[], uint32_t num_points, rgba c);
-void bf_plot_julia(const buffer buff, double cx, double cy, rgba col);
+void bf_plot_bars(const buffer buff, const axes ax, const sample_t data[], uint32_t num_points, rgba c);
+void bf_plot_line(const buffer buff, const axes ax, const sample_t data[], uint32_t num_points, rgba c);
+void bf_plot_polar(const buffer buff, const axes ax, const sample_t data[], uint32_t num_points, rgba c);
+void bf_plot_osc(const buffer buff, const axes ax, const sample_t data_x[], const sample_t data_y[], uint32_t num_points, rgba c);
+void bf_plot_julia(const buffer buff, double cx, double cy, rgba col, int quality, double frame_ms);
@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "output/text.h"
+
+#include "debug.h"
+#include "util.h"
+
+
+void text_init(struct text_cache *tc) {
+    memset(tc, 0, sizeof(*tc));
+}
+
+void text_flush(struct text_cache *tc) {
+    debug("text: flushing %d glyphs, %d atlas rows\n", tc->glyphs, tc->shelf_y + tc->shelf_h);
+    memset(tc->glyph, 0, sizeof(tc->glyph));
+    memset(tc->layout, 0, sizeof(tc->layout));
+    tc->glyphs = 0;
+    tc->shelf_x = tc->shelf_y = tc->shelf_h = 0;
+}
+
+void text_free(struct text_cache *tc) {
+    free(tc->atlas);
+    text_init(tc);
+}
+
+// djb2, over the key's fields and then the bytes of the text
+static unsigned long text_hash(FT_Face face, int size, const char *text, int n) {
+    unsigned long hash = 5381;
+    hash = hash * 33 + (unsigned long)(uintptr_t)face;
+    hash = hash * 33 + (unsigned long)size;
+    for (int i = 0; i < n; i++) {
+        hash = hash * 33 + (unsigned char)text[i];
+    }
+    return hash;
+}
+
+// room in the atlas for a w x h bitmap, growing it if need be; false if it is full
+static bool text_place(struct text_cache *tc, int w, int h, uint16_t *x, uint16_t *y) {
+    if (tc->shelf_x + w > TEXT_ATLAS_W) {
+        // a new shelf under the last
+        tc->shelf_y += tc->shelf_h;
+        tc->shelf_x = tc->shelf_h = 0;
+    }
+    int bottom = tc->shelf_y + max(tc->shelf_h, h);
+    if (bottom > TEXT_ATLAS_H_MAX)
+        return false;
+    if (bottom > tc->atlas_h) {
+        int rows = max(bottom, min(2 * tc->atlas_h, TEXT_ATLAS_H_MAX));
+        uint8_t *atlas = realloc(tc->atlas, (size_t)TEXT_ATLAS_W * rows);
+        if (atlas == NULL)
+            return false;
+        tc->atlas = atlas;
+        tc->atlas_h = rows;
+    }
+    *x = (uint16_t)tc->shelf_x;
+    *y = (uint16_t)tc->shelf_y;
+    tc->shelf_x += w;
+    tc->shelf_h = max(tc->shelf_h, h);
+    return true;
+}
+
+// the slot of the glyph of code in face at size, rendering it on a miss; -1 if the cache
+// is full
+static int text_glyph(struct text_cache *tc, FT_Face face, int size, int dpi, uint32_t code) {
+    unsigned long hash = text_hash(face, size, NULL, 0) * 33 + code;
+    int slot = (int)(hash & (TEXT_GLYPHS - 1));
+    for (;;) {
+        struct glyph *g = &tc->glyph[slot];
+        if (g->face == NULL)
+            break;
+        if (g->face == face && g->size == size && g->code == code)
+            return slot;
+        slot = (slot + 1) & (TEXT_GLYPHS - 1);
+    }
+    if (tc->glyphs >= TEXT_GLYPHS_MAX)
+        return -1;
+
+    struct glyph *g = &tc->glyph[slot];
+    memset(g, 0, sizeof(*g));
+    // the size is set only on a miss, as it drops FreeType's own caches
+    FT_Set_Char_Size(face, 0, size * 64, dpi, dpi);
+    FT_GlyphSlot fg = face->glyph;
+    // glyphs that fail to load are kept with no bitmap and no advance, as if skipped
+    if (!FT_Load_Char(face, code, FT_LOAD_RENDER)) {
+        // grayscale coverage, because text may be any colour
+        const FT_Bitmap *b = &fg->bitmap;
+        // a glyph too wide for the atlas, in a huge size, is left blank
+        if (b->width && b->rows && b->width <= TEXT_ATLAS_W) {
+            if (!text_place(tc, b->width, b->rows, &g->x, &g->y))
+                return -1;
+            for (unsigned int dy = 0; dy < b->rows; dy++) {
+                memcpy(tc->atlas + (size_t)(g->y + dy) * TEXT_ATLAS_W + g->x, b->buffer + (int)dy * b->pitch, b->width);
+            }
+            g->w = (uint16_t)b->width;
+            g->h = (uint16_t)b->rows;
+        }
+        g->top = (int16_t)fg->bitmap_top;
+        g->advance = (int16_t)(fg->advance.x >> 6);
+    }
+    g->face = face;
+    g->size = size;
+    g->code = code;
+    tc->glyphs++;
+    return slot;
+}
+
+// lay out text into l; if the glyph cache fills up on the way, l has the characters
+// before, and isn't kept
+static bool text_lay(struct text_cache *tc, struct layout *l, FT_Face face, int size, int dpi, const char *text, int n) {
+    l->face = NULL;
+    l->n = l->width = 0;
+    for (int i = 0; i < n; i++) {
+        int slot = text_glyph(tc, face, size, dpi, (unsigned char)text[i]);
+        if (slot < 0)
+            return false;
+        l->glyph[i] = (uint16_t)slot;
+        l->pen[i] = (int16_t)l->width;
+        l->width += tc->glyph[slot].advance;
+        l->n = i + 1;
+    }
+    memcpy(l->text, text, n);
+    l->face = face;
+    l->size = size;
+    return true;
+}
+
+const struct layout *text_layout(struct text_cache *tc, FT_Face face, int size, int dpi, const char *text, int n) {
+    n = min(max(n, 0), TEXT_LAYOUT_CHARS);
+    struct layout *l = &tc->layout[text_hash(face, size, text, n) & (TEXT_LAYOUTS - 1)];
+    if (l->face == face && l->size == size && l->n == n && !memcmp(l->text, text, n))
+        return l;
+    // a string that clashes with another replaces it
+    if (!text_lay(tc, l, face, size, dpi, text, n)) {
+        // start afresh; one string can't fill the cache
+        text_flush(tc);
+        text_lay(tc, l, face, size, dpi, text, n);
+    }
+    return l;
+}
@@ -0,0 +1,66 @@
+// Caches of rendered glyphs and laid out strings, for bf_text().
+// FreeType renders each glyph once per face, size and character, into one coverage
+// atlas packed in shelves; a string is then a list of glyphs and pen positions, which is
+// itself kept for strings drawn again, such as labels redrawn every frame. Both are
+// emptied when they fill up, and must be when a face is closed.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+// the atlas is TEXT_ATLAS_W coverage bytes wide, and grows down to TEXT_ATLAS_H_MAX rows
+#define TEXT_ATLAS_W 1024
+#define TEXT_ATLAS_H_MAX 4096
+// slots of the glyph table, a power of two, and the glyphs kept before it is emptied
+#define TEXT_GLYPHS 1024
+#define TEXT_GLYPHS_MAX (TEXT_GLYPHS * 3 / 4)
+// slots of the string table, a power of two, and the longest string laid out
+#define TEXT_LAYOUTS 64
+#define TEXT_LAYOUT_CHARS 64
+
+struct glyph {
+    FT_Face face;               // NULL for an empty slot
+    int size;
+    uint32_t code;
+    uint16_t x, y, w, h;        // the bitmap in the atlas
+    int16_t top;                // rows above the baseline
+    int16_t advance;            // pixels to the next pen position
+};
+
+struct layout {
+    FT_Face face;               // NULL for an empty slot
+    int size;
+    int n;
+    char text[TEXT_LAYOUT_CHARS];
+    int width;
+    uint16_t glyph[TEXT_LAYOUT_CHARS];  // slots in the glyph table
+    int16_t pen[TEXT_LAYOUT_CHARS];     // pen positions from the start
+};
+
+struct text_cache {
+    uint8_t *atlas;             // TEXT_ATLAS_W * atlas_h
+    int atlas_h;
+    int shelf_x, shelf_y, shelf_h;      // the free space of the open shelf
+    int glyphs;
+    struct glyph glyph[TEXT_GLYPHS];
+    struct layout layout[TEXT_LAYOUTS];
+};
+
+void text_init(struct text_cache *tc);
+
+// the first n (up to TEXT_LAYOUT_CHARS) characters of text in face at size points,
+// rendering the glyphs not already in the atlas
+const struct layout *text_layout(struct text_cache *tc, FT_Face face, int size, int dpi, const char *text, int n);
+
+// coverage of row dy of a glyph, from its top
+static inline const uint8_t *text_row(const struct text_cache *tc, const struct glyph *g, int dy) {
+    return tc->atlas + (size_t)(g->y + dy) * TEXT_ATLAS_W + g->x;
+}
+
+void text_flush(struct text_cache *tc);
+
+void text_free(struct text_cache *tc);
@@ -1,11 +1,15 @@
 #include "output/vis.h"
 
 
+// dB between the lowest noise floor and the bottom of the fft axes, with auto_range
+#define FLOOR_MARGIN 10
+
 char textstr[50];
 int length;
 int rotate;
 
 double peak_dB = -10.0;
+double floor_dB = DB_FLOOR;
 double peak_l = 0, peak_r = 0;
 double ppm_l = -60, ppm_r = -60;
 
@@ -18,6 +22,22 @@ clock_t last_fps_timer = 0;
 
 buffer buffer_final;
 buffer buffer_clock;
+// the layers: a background redrawn when it changes, the traces in buffer_final, and the
+// text and readouts
+buffer buffer_static;
+buffer buffer_overlay;
+layer layers[LAYERS];
+
+// what the static layer shows
+enum static_layout {STATIC_PPM = 1, STATIC_FFT, STATIC_OCT};
+
+// spectrum on display, and its noise floor clipped to the axes
+struct spectrum fft_frame;
+sample_t *trace;
+
+// octave band levels, and the bars they are drawn as
+sample_t *oct_l, *oct_r;
+sample_t *oct_bars_l, *oct_bars_r;
 
 
 void axes_update(struct audio_data *audio, axes *ax_l, axes *ax_r) {
@@ -48,6 +68,7 @@ void vis_init(struct config_params *p, axes *ax_r, axes *ax_l, rgba text_c, rgba
 
     // config: font
     freetype_init(p->text_font, p->audio_font);
+    bf_threads_init(p->render_threads);
 
     /*** set up sdl display ***/
     rotate = p->rotate;
@@ -73,10 +94,16 @@ void vis_init(struct config_params *p, axes *ax_r, axes *ax_l, rgba text_c, rgba
     ax_r->y_max = ax_l->y_max;
 
     // plotting init
-    sdl_init(p->width, p->height, &text_c, &bg_c, p->rotate, p->fullscreen);
+    sdl_init(p->width, p->height, &text_c, &bg_c, p->rotate, p->fullscreen, p->streaming);
     bf_init(&buffer_final, p->width, p->height);
     bf_clear(buffer_final);
     bf_init(&buffer_clock, p->width, p->height);
+    bf_init(&buffer_static, p->width, p->height);
+    bf_init(&buffer_overlay, p->width, p->height);
+    layers[LAYER_STATIC].buff = buffer_static;
+    layers[LAYER_DYNAMIC].buff = buffer_final;
+    layers[LAYER_OVERLAY].buff = buffer_overlay;
+    layers[LAYER_DYNAMIC].shown = true;
 
 }
 
@@ -84,8 +111,17 @@ void vis_cleanup() {
     // free screen buffers
     bf_free_pixels(&buffer_final);
     bf_free_pixels(&buffer_clock);
+    bf_free_pixels(&buffer_static);
+    bf_free_pixels(&buffer_overlay);
+    spectrum_free(&fft_frame);
+    free(trace);
+    free(oct_l);
+    free(oct_r);
+    free(oct_bars_l);
+    free(oct_bars_r);
 
     freetype_cleanup();
+    bf_threads_cleanup();
     sdl_cleanup();
 }
 
@@ -94,6 +130,65 @@ void vis_sleep(long double nsec) {
     nanosleep(&req, NULL);
 }
 
+// show the static and overlay layers or not, for the vis in hand
+static void vis_layers(bool with_static, bool with_overlay) {
+    layers[LAYER_STATIC].shown = with_static;
+    layers[LAYER_OVERLAY].shown = with_overlay;
+    layers[LAYER_DYNAMIC].fade = 0;
+}
+
+// fade the traces by persistence for the trails, on the renderer if it can and the last
+// frame's pixels aren't needed here, as they are to blur them
+static void vis_fade(struct config_params *p, double persistence, bool blurred) {
+    if (p->gpu_persistence && !blurred && sdl_can_fade()) {
+        bf_clear(buffer_final);
+        layers[LAYER_DYNAMIC].fade = persistence;
+    } else {
+        bf_shade(buffer_final, persistence);
+    }
+}
+
+// whether the static layer must be redrawn to show what key describes, which it then
+// does; keys are compared bytewise, so are zeroed before they are filled in
+static bool vis_static_stale(const void *key, size_t size) {
+    static unsigned char last[256];
+    static size_t last_size = 0;
+    if (size == last_size && !memcmp(key, last, size))
+        return false;
+    last_size = min(size, sizeof(last));
+    memcpy(last, key, last_size);
+    bf_clear(buffer_static);
+    return true;
+}
+
+// the fft or oct axes on the static layer, redrawn when their ticks move
+static void vis_axes(enum static_layout layout, axes ax, rgba ax_c, rgba ax2_c) {
+    struct {
+        enum static_layout layout;
+        axes ax;
+        rgba ax_c, ax2_c;
+        int ticks;
+        uint32_t rows[32];
+    } key;
+    memset(&key, 0, sizeof(key));
+    key.layout = layout;
+    key.ax = ax;
+    key.ax_c = ax_c;
+    key.ax2_c = ax2_c;
+    // the dB range changes every frame, but the ticks only now and then
+    key.ax.y_min = key.ax.y_max = 0;
+    for (int n = ax.y_max; n >= ax.y_min; n -= 20) {
+        if (key.ticks == (int)ARRAY_SIZE(key.rows)) {
+            key.ax = ax;
+            break;
+        }
+        key.rows[key.ticks++] = bf_ytick_y(ax, n);
+    }
+    if (vis_static_stale(&key, sizeof(key))) {
+        bf_plot_axes(buffer_static, ax, ax_c, ax2_c);
+    }
+}
+
 void vis_ppm(struct audio_data *audio, int window_w, axes ax_l, rgba audio_c, rgba ax_c, rgba ax2_c, rgba plot_l_c, rgba plot_r_c) {
 
     // PPM
@@ -128,64 +223,84 @@ void vis_ppm(struct audio_data *audio, int window_w, axes ax_l, rgba audio_c, rg
     // the pole at -1.3545 corresponds to 20dB decay / 1.7s
     // as per Type I IEC 60268-10 (DIN PPM) spec.
     // ppm_l, ppm_r are the meter readings in dB.
-    ppm_l = exp(-1.3545 * dt_ms / 1000) * ppm_l + fmax(20 * log10(peak_l) - 80.3, min_dB) * dt_ms / 1000;
-    ppm_r = exp(-1.3545 * dt_ms / 1000) * ppm_r + fmax(20 * log10(peak_r) - 80.3, min_dB) * dt_ms / 1000;
+    // 20 log10(peak) is 20 log10(2) log2(peak)
+    double decay = exp(-1.3545 * dt_ms / 1000);
+    ppm_l = decay * ppm_l + fmax(6.0205999 * fast_log2(peak_l) - 80.3, min_dB) * dt_ms / 1000;
+    ppm_r = decay * ppm_r + fmax(6.0205999 * fast_log2(peak_r) - 80.3, min_dB) * dt_ms / 1000;
     double angle_l = ppm_l * m + c;
     double angle_r = ppm_r * m + c;
     // Draw left and right needles on one dial.
     int r = (int)(ppm_scale * 320);     // needle radius
     int x0 = (int)buffer_final.w / 2;   // needle origin (x)
     int y0 = (int)ppm_scale * 60;       // needle origin (y)
-    // render the dial to the buffer
-    bf_clear(buffer_final);
-    bf_text(buffer_final, "DIN PPM", 7, (int)(ppm_scale * 10), false, ax_l.screen_x + (int)(ppm_scale * 10), ax_l.screen_y + ax_l.screen_h - (int)(ppm_scale * 80), 0, audio_c);
-    // dB scale markings
-    for (double dB = min_dB; dB < 0; dB += 5) {
-        bf_draw_ray(buffer_final, x0, y0, r+(int)(ppm_scale * 3), r+(int)(ppm_scale * 10), dB * m + c, (int)(ppm_scale * 4), ax_c);
-    }
-    for (double dB = min_dB; dB < 0; dB += 10) {
-        bf_draw_ray(buffer_final, x0, y0, r+(int)(ppm_scale * 3), r+(int)(ppm_scale * 22), dB * m + c, (int)(ppm_scale * 4), ax_c);
-    }
-    // scale labels
-    int x, y;
-    bf_ray_xy(x0, y0, r + 30, -50 * m + c, &x, &y);
-    bf_text(buffer_final, "-50", 3, (int)(ppm_scale * 8), false, x - (int)(ppm_scale * 24), y, 0, audio_c);
-    bf_ray_xy(x0, y0, r + 30, c, &x, &y);
-    bf_text(buffer_final, "0", 1, (int)(ppm_scale * 8), false, x + (int)(ppm_scale * 3), y + (int)(ppm_scale * 8), 0, audio_c);
-    bf_ray_xy(x0, y0, r + 30, 5 * m + c, &x, &y);
-    bf_text(buffer_final, "+5", 2, (int)(ppm_scale * 8), false, x, y, 0, ax2_c);
-    // dB excess
-    for (double dB = 0; dB <= max_dB; dB += 5) {
-        bf_draw_ray(buffer_final, x0, y0, r+10, r+(int)(ppm_scale * 22), dB * m + c, (int)(ppm_scale * 4), ax2_c);
+    // the dial is static, redrawn only when its size, colours or rate change
+    vis_layers(true, true);
+    struct {
+        enum static_layout layout;
+        int window_w, rate;
+        axes ax;
+        rgba audio_c, ax_c, ax2_c;
+    } key;
+    memset(&key, 0, sizeof(key));
+    key.layout = STATIC_PPM;
+    key.window_w = window_w;
+    key.rate = audio->rate;
+    key.ax = ax_l;
+    key.audio_c = audio_c;
+    key.ax_c = ax_c;
+    key.ax2_c = ax2_c;
+    if (vis_static_stale(&key, sizeof(key))) {
+        bf_text(buffer_static, "DIN PPM", 7, (int)(ppm_scale * 10), false, ax_l.screen_x + (int)(ppm_scale * 10), ax_l.screen_y + ax_l.screen_h - (int)(ppm_scale * 80), 0, audio_c);
+        // dB scale markings
+        for (double dB = min_dB; dB < 0; dB += 5) {
+            bf_draw_ray(buffer_static, x0, y0, r+(int)(ppm_scale * 3), r+(int)(ppm_scale * 10), dB * m + c, (int)(ppm_scale * 4), ax_c);
+        }
+        for (double dB = min_dB; dB < 0; dB += 10) {
+            bf_draw_ray(buffer_static, x0, y0, r+(int)(ppm_scale * 3), r+(int)(ppm_scale * 22), dB * m + c, (int)(ppm_scale * 4), ax_c);
+        }
+        // scale labels
+        int x, y;
+        bf_ray_xy(x0, y0, r + 30, -50 * m + c, &x, &y);
+        bf_text(buffer_static, "-50", 3, (int)(ppm_scale * 8), false, x - (int)(ppm_scale * 24), y, 0, audio_c);
+        bf_ray_xy(x0, y0, r + 30, c, &x, &y);
+        bf_text(buffer_static, "0", 1, (int)(ppm_scale * 8), false, x + (int)(ppm_scale * 3), y + (int)(ppm_scale * 8), 0, audio_c);
+        bf_ray_xy(x0, y0, r + 30, 5 * m + c, &x, &y);
+        bf_text(buffer_static, "+5", 2, (int)(ppm_scale * 8), false, x, y, 0, ax2_c);
+        // dB excess
+        for (double dB = 0; dB <= max_dB; dB += 5) {
+            bf_draw_ray(buffer_static, x0, y0, r+10, r+(int)(ppm_scale * 22), dB * m + c, (int)(ppm_scale * 4), ax2_c);
+        }
+        // main dial, and the dial excess
+        bf_draw_arc(buffer_static, x0, y0, r, min_dB * m + c, max_dB * m + c, (int)(ppm_scale * 2), ax_c);
+        bf_draw_arc(buffer_static, x0, y0, r+(int)(ppm_scale * 10), c, max_dB * m + c, (int)(ppm_scale * 5), ax2_c);
+        bf_text(buffer_static, "dB", 2, (int)(ppm_scale * 16), true, 0, y0, 0, audio_c);
+        // top right text: sampling rate
+        sprintf(textstr, "%4.1fkHz", (double)audio->rate / 1000);
+        bf_text(buffer_static, textstr, 7, (int)(ppm_scale * 10), false, ax_l.screen_x + ax_l.screen_w - (int)(ppm_scale * 120), ax_l.screen_y + ax_l.screen_h - (int)(ppm_scale * 80), 0, audio_c);
     }
-    // main dial
-    bf_draw_arc(buffer_final, x0, y0, r, min_dB * m + c, max_dB * m + c, (int)(ppm_scale * 2), ax_c);
-    // dial excess; glow if hit
+
+    // render the needles to the buffer
+    bf_clear(buffer_final);
+    // dial excess glows if hit
     if (ppm_l >= 0 || ppm_r >= 0 || clip) {
         rgba excess_c = ax2_c;
         excess_c.r = 255;
         bf_draw_arc(buffer_final, x0, y0, r+(int)(ppm_scale * 10), c, max_dB * m + c, (int)(ppm_scale * 6), excess_c);
-    } else {
-        bf_draw_arc(buffer_final, x0, y0, r+(int)(ppm_scale * 10), c, max_dB * m + c, (int)(ppm_scale * 5), ax2_c);
     }
     // readings
     bf_draw_ray(buffer_final, x0, y0, r - (int)(ppm_scale * 100), r + (int)(ppm_scale * 20), angle_l, (int)(ppm_scale * 5), plot_l_c);
     bf_draw_ray(buffer_final, x0, y0, r - (int)(ppm_scale * 100), r + (int)(ppm_scale * 20), angle_r, (int)(ppm_scale * 5), plot_r_c);
+    bf_clear(buffer_overlay);
     sprintf(textstr, "%+03.0fdB", ppm_l);
-    bf_text(buffer_final, textstr, 5, (int)(ppm_scale * 8), false, ax_l.screen_x + (int)(ppm_scale * 10), y0, 0, audio_c);
+    bf_text(buffer_overlay, textstr, 5, (int)(ppm_scale * 8), false, ax_l.screen_x + (int)(ppm_scale * 10), y0, 0, audio_c);
     sprintf(textstr, "%+03.0fdB", ppm_r);
-    bf_text(buffer_final, textstr, 5, (int)(ppm_scale * 8), false, ax_l.screen_w - (int)(ppm_scale * 100), y0, 0, audio_c);
-    bf_text(buffer_final, "dB", 2, (int)(ppm_scale * 16), true, 0, y0, 0, audio_c);
-
-    // top right text: sampling rate
-    sprintf(textstr, "%4.1fkHz", (double)audio->rate / 1000);
-    bf_text(buffer_final, textstr, 7, (int)(ppm_scale * 10), false, ax_l.screen_x + ax_l.screen_w - (int)(ppm_scale * 120), ax_l.screen_y + ax_l.screen_h - (int)(ppm_scale * 80), 0, audio_c);
+    bf_text(buffer_overlay, textstr, 5, (int)(ppm_scale * 8), false, ax_l.screen_w - (int)(ppm_scale * 100), y0, 0, audio_c);
 
     vis_sleep(2e9 / 3000);
 
 }
 
-void vis_osc(struct audio_data *audio, axes *ax_l, axes *ax_r, rgba osc_c) {
+void vis_osc(struct audio_data *audio, struct config_params *p, axes *ax_l, axes *ax_r, rgba osc_c) {
 
     // oscilloscope waveform plotter to framebuffer
     ax_l->y_min = -32766;
@@ -193,8 +308,9 @@ void vis_osc(struct audio_data *audio, axes *ax_l, axes *ax_r, rgba osc_c) {
     ax_l->y_max = 32766;
     ax_r->y_max = 32766;
 
-    bf_blur(buffer_final);
-    bf_shade(buffer_final, 0.8);    // 0.8 is not bad
+    vis_layers(false, false);
+    bf_blur(buffer_final, p->blur_radius, p->blur_passes);
+    vis_fade(p, 0.8, p->blur_radius > 0 && p->blur_passes > 0);    // 0.8 is not bad
 
     bf_plot_osc(buffer_final, *ax_l, audio->in_l, audio->in_r, audio->FFTbufferSize, osc_c);
     vis_sleep(2e9 / 3000);
@@ -208,51 +324,188 @@ void vis_pcm(struct audio_data *audio, axes *ax_l, axes *ax_r, rgba plot_l_c, rg
     ax_r->y_min = -32766;
     ax_l->y_max = 32766;
     ax_r->y_max = 32766;
+    vis_layers(false, false);
     bf_clear(buffer_final);
     bf_plot_line(buffer_final, *ax_l, audio->in_l, audio->FFTbufferSize, plot_l_c);
     bf_plot_line(buffer_final, *ax_r, audio->in_r, audio->FFTbufferSize, plot_r_c);
 
 }
 
-void vis_fft(struct audio_data *audio, fftw_plan p_l, fftw_plan p_r, struct config_params *p, axes ax_l, axes ax_r, rgba ax_c, rgba ax2_c, rgba plot_l_c, rgba plot_r_c) {
+// label the loudest peaks of both channels with their frequency and nearest note,
+// in the colour of the louder channel's bars, which vis_fft draws left in plot_r_c
+void vis_peak_labels(const struct spectrum *s, int labels, axes ax, rgba plot_l_c, rgba plot_r_c) {
+    struct peak peaks[2 * PEAKS_MAX];
+    bool left[2 * PEAKS_MAX];
+    int count = 0;
+    // merge the channels, keeping the louder of peaks within a quarter tone of each other
+    for (int c = 0; c < 2; c++) {
+        const struct peak *channel = c ? s->peaks_r : s->peaks_l;
+        int found = c ? s->number_of_peaks_r : s->number_of_peaks_l;
+        for (int j = 0; j < found; j++) {
+            int m = 0;
+            while (m < count && fabs(log2(channel[j].f / peaks[m].f)) > 1.0 / 24) {
+                m++;
+            }
+            if (m == count) {
+                count++;
+            } else if (peaks[m].dB >= channel[j].dB) {
+                continue;
+            }
+            peaks[m] = channel[j];
+            left[m] = !c;
+        }
+    }
+    int size = max(6, (int)ax.screen_w / 100);
+    for (int n = 0; n < labels && count > 0; n++) {
+        // the loudest left
+        int loudest = 0;
+        for (int m = 1; m < count; m++) {
+            loudest = peaks[m].dB > peaks[loudest].dB ? m : loudest;
+        }
+        const struct peak *pk = &peaks[loudest];
+        char note[16];
+        peaks_note(pk->f, note, sizeof(note));
+        length = snprintf(textstr, sizeof(textstr), pk->f < 1000 ? "%.1fHz %s" : "%.0fHz %s", pk->f, note);
+        length = min(length, (int)sizeof(textstr) - 1);
+        // just above the peak, and on screen
+        double x = ax.screen_w * (log10(pk->f) - ax.x_min) / (ax.x_max - ax.x_min);
+        double y = ax.screen_h * (pk->dB - ax.y_min) / (ax.y_max - ax.y_min) + size / 2;
+        x = fmin(fmax(x - size * 2, 0), ax.screen_w - size * length);
+        y = fmin(fmax(y, 0), ax.screen_h - 2 * size);
+        bf_text(buffer_overlay, textstr, length, size, false, ax.screen_x + (uint32_t)x, ax.screen_y + (uint32_t)y, 0,
+                left[loudest] ? plot_r_c : plot_l_c);
+        peaks[loudest] = peaks[--count];
+        left[loudest] = left[count];
+    }
+}
 
-    // window, execute FFT
-    window(audio, HANN);
-    fftw_execute(p_l);
-    fftw_execute(p_r);
+void vis_fft(struct analysis *analysis, struct config_params *p, axes ax_l, axes ax_r, rgba ax_c, rgba ax2_c, rgba plot_l_c, rgba plot_r_c) {
 
-    // integrate power
-    int number_of_bars = ax_l.screen_w / 2;
-    int *bins_left = make_bins(audio, number_of_bars, LEFT_CHANNEL); 
-    int *bins_right = make_bins(audio, number_of_bars, RIGHT_CHANNEL); 
+    // take the newest analysed frame; between frames, redraw the last one
+    if (fft_frame.bins_l == NULL) {
+        spectrum_alloc(&fft_frame, analysis->number_of_bins);
+        trace = calloc(analysis->number_of_bins, sizeof(sample_t));
+    }
+    analysis_latest(analysis, &fft_frame);
+
+    int number_of_bars = analysis->number_of_bins;
+    // the bins span the cutoff frequencies, or the zoomed band
+    ax_l.x_min = ax_r.x_min = log10(fft_frame.f_lo);
+    ax_l.x_max = ax_r.x_max = log10(fft_frame.f_hi);
+    sample_t *bins_left = fft_frame.bins_l;
+    sample_t *bins_right = fft_frame.bins_r;
 
     // FFT plotter to framebuffer
-    // set plotting axes; persistent as based on bins_lr
+    // set plotting axes; persistent as based on bins_lr, which are in dB
+    sample_t peak = peak_dB;
     for (int n = 0; n < number_of_bars; n++) {
-        double dB = 10 * log10(fmax(bins_left[n], bins_right[n]));
-        peak_dB = fmax(dB, peak_dB);
+        peak = bins_left[n] > peak ? bins_left[n] : peak;
+        peak = bins_right[n] > peak ? bins_right[n] : peak;
     }
+    peak_dB = peak;
     ax_l.y_max = peak_dB;
     ax_l.y_min = peak_dB + p->noise_floor;
-    ax_r.y_max = peak_dB;
-    ax_r.y_min = peak_dB + p->noise_floor;
+    if (p->auto_range) {
+        // the lowest tracked floor, a little below, but no further below the peak than noise_floor;
+        // bins the transform doesn't reach sit at DB_FLOOR and don't count
+        sample_t lowest = peak_dB;
+        for (int n = 0; n < number_of_bars; n++) {
+            sample_t f = fmin(fft_frame.floor_l[n], fft_frame.floor_r[n]);
+            lowest = f < lowest && f > DB_FLOOR ? f : lowest;
+        }
+        // settle gently, so the scale doesn't jump about
+        floor_dB = floor_dB == DB_FLOOR ? lowest : 0.95 * floor_dB + 0.05 * lowest;
+        ax_l.y_min = fmax(ax_l.y_min, fmin(floor_dB - FLOOR_MARGIN, peak_dB - FLOOR_MARGIN));
+    }
+    ax_r.y_max = ax_l.y_max;
+    ax_r.y_min = ax_l.y_min;
+
+    // bars below the floor are left out, by putting them at the bottom of the axes
+    if (p->floor_gate) {
+        for (int n = 0; n < number_of_bars; n++) {
+            bins_left[n] = bins_left[n] < fft_frame.floor_l[n] ? ax_l.y_min : bins_left[n];
+            bins_right[n] = bins_right[n] < fft_frame.floor_r[n] ? ax_r.y_min : bins_right[n];
+        }
+    }
 
-    bf_shade(buffer_final, p->persistence);
+    vis_layers(true, p->peak_labels > 0);
+    vis_axes(STATIC_FFT, ax_l, ax_c, ax2_c);
+
+    // the analysis averages the spectrum, so only fade the pixels if it doesn't
+    if (analysis->average.mode == AVERAGE_NONE) {
+        vis_fade(p, p->persistence, false);
+    } else {
+        bf_clear(buffer_final);
+    }
     // plot spectrum
     bf_plot_bars(buffer_final, ax_l, bins_right, number_of_bars, plot_l_c);
     bf_plot_bars(buffer_final, ax_r, bins_left, number_of_bars, plot_r_c);
-    bf_plot_axes(buffer_final, ax_l, ax_c, ax2_c);
+    if (p->floor_trace) {
+        // the louder channel's floor, kept on the axes
+        for (int n = 0; n < number_of_bars; n++) {
+            trace[n] = fmin(ax_l.y_max, fmax(ax_l.y_min, fmax(fft_frame.floor_l[n], fft_frame.floor_r[n])));
+        }
+        bf_plot_line(buffer_final, ax_l, trace, number_of_bars, ax2_c);
+    }
+    if (p->peak_labels) {
+        bf_clear(buffer_overlay);
+        vis_peak_labels(&fft_frame, p->peak_labels, ax_l, plot_l_c, plot_r_c);
+    }
 
     // sleep to time with the shmem input refresh rate
     vis_sleep(2e9 / 3000);
 
 }
 
-void vis_polar(struct audio_data *audio, axes *ax_l, axes *ax_r, rgba plot_l_c, rgba plot_r_c) {
+void vis_oct(struct octave *octave, struct config_params *p, axes ax_l, axes ax_r, rgba ax_c, rgba ax2_c, rgba plot_l_c, rgba plot_r_c) {
+
+    // one bar per two pixels, as for the fft
+    int number_of_bars = ax_l.screen_w / 2;
+    if (oct_l == NULL) {
+        oct_l = calloc(octave->bands, sizeof(sample_t));
+        oct_r = calloc(octave->bands, sizeof(sample_t));
+        oct_bars_l = calloc(number_of_bars, sizeof(sample_t));
+        oct_bars_r = calloc(number_of_bars, sizeof(sample_t));
+    }
+    octave_levels(octave, oct_l, oct_r);
+    power_dB(oct_l, oct_l, octave->bands);
+    power_dB(oct_r, oct_r, octave->bands);
+
+    // the bands are equally spaced on the log frequency axis
+    double lo, hi;
+    octave_edges(octave, &lo, &hi);
+    ax_l.x_min = ax_r.x_min = log10(lo);
+    ax_l.x_max = ax_r.x_max = log10(hi);
+    // levels are absolute, with full scale at the top
+    ax_l.y_max = ax_r.y_max = 20 * log10(32768);
+    ax_l.y_min = ax_r.y_min = ax_l.y_max + p->noise_floor;
+
+    // each band is a run of bars, with a gap at the floor between bands
+    for (int n = 0; n < number_of_bars; n++) {
+        int band = n * octave->bands / number_of_bars;
+        bool edge = (n + 1) * octave->bands / number_of_bars != band;
+        oct_bars_l[n] = edge ? ax_l.y_min : oct_l[band];
+        oct_bars_r[n] = edge ? ax_l.y_min : oct_r[band];
+    }
+
+    vis_layers(true, false);
+    vis_axes(STATIC_OCT, ax_l, ax_c, ax2_c);
+
+    // the bands are time weighted as they are filtered, so redraw from clear
+    bf_clear(buffer_final);
+    bf_plot_bars(buffer_final, ax_l, oct_bars_r, number_of_bars, plot_l_c);
+    bf_plot_bars(buffer_final, ax_r, oct_bars_l, number_of_bars, plot_r_c);
+
+    vis_sleep(2e9 / 3000);
+
+}
+
+void vis_polar(struct audio_data *audio, struct config_params *p, axes *ax_l, axes *ax_r, rgba plot_l_c, rgba plot_r_c) {
 
     // plot the sample in a polar plot
-    bf_blur(buffer_final);
-    bf_shade(buffer_final, 0.85);
+    vis_layers(false, false);
+    bf_blur(buffer_final, p->blur_radius, p->blur_passes);
+    vis_fade(p, 0.85, p->blur_radius > 0 && p->blur_passes > 0);
 
     // last 75 ms
     double ms = 75.0;
@@ -263,9 +516,10 @@ void vis_polar(struct audio_data *audio, axes *ax_l, axes *ax_r, rgba plot_l_c,
 
 }
 
-void vis_julia(struct audio_data *audio, rgba col) {
+void vis_julia(struct audio_data *audio, struct config_params *p, rgba col) {
 
-    bf_blur(buffer_final);
+    vis_layers(false, false);
+    bf_blur(buffer_final, p->blur_radius, p->blur_passes);
     bf_shade(buffer_final, 0.999);
 
     double peak_l = 0;
@@ -289,7 +543,7 @@ void vis_julia(struct audio_data *audio, rgba col) {
     double cx = r * cos(theta);
     double cy = r * sin(theta);
 
-    bf_plot_julia(buffer_final, cx, cy, col);
+    bf_plot_julia(buffer_final, cx, cy, col, p->julia_quality, p->julia_frame_ms);
 
     //sprintf(textstr, "cx: %+3.2f, cy: %+3.2f", cx, cy);
     //bf_text(buffer_final, textstr, 20, 8, false, 10, 10, 0, col);
@@ -304,6 +558,7 @@ void vis_clock(int window_w, rgba text_c) {
     time(&now);
     // if audio is paused wait and continue
     // show a clock, screensaver or something
+    vis_layers(false, false);
     bf_shade(buffer_clock, 0.99);
     double clock_scale = window_w / 800.0;
     length = strftime(textstr, sizeof(textstr), "%H:%M", localtime(&now));
@@ -318,5 +573,5 @@ void vis_clock(int window_w, rgba text_c) {
 }
 
 void vis_blit() {
-    bf_blit(buffer_final, 15, rotate);
+    bf_blit(layers, 15, rotate);
 }
@@ -4,24 +4,52 @@
 #include <stdlib.h>
 #endif
 
+#include <ctype.h>
+#include <limits.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <fftw3.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/utsname.h>
 
 #include "input/common.h"
 #include "sigproc.h"
+#include "analysis/weighting.h"
 
 #include "debug.h"
 #include "util.h"
 
 
-// apply window in-place on audio data
-void window(struct audio_data *audio, int type) {
+// FFTW planner rigour, set from the config
+static unsigned int planner_flags = FFTW_MEASURE;
+// threads for large transforms, set from the config
+static int planner_threads = 1;
+// new plans were made that are not yet in the wisdom file
+static bool wisdom_dirty = false;
+
+// window coefficients of the given type and length, computed once and cached
+const sample_t *window_table(int size, int type) {
+    static struct {
+        int size, type;
+        sample_t *w;
+    } cache[8];
+    static int cached = 0;
     double a0, a1, a2, a3;
+
+    for (int n = 0; n < cached; n++) {
+        if (cache[n].size == size && cache[n].type == type) {
+            return cache[n].w;
+        }
+    }
+
     if (type == RECT) {
         // rectangular window
         a0=1; a1=0.0; a2=0; a3=0;
@@ -32,67 +60,441 @@ void window(struct audio_data *audio, int type) {
     } else if (type == BLAC) {
         // Blackman-Nuttall window
         a0=0.3635819; a1=0.4891775; a2=0.1365995; a3=0.0106411;
+    } else if (type == DHAN) {
+        // d/di of the Hann window, (pi / size) sin(2 pi i / size)
+        a0=0; a1=0; a2=0; a3=0;
     } else {
         fprintf(stderr, "Windowing type not implemented");
         exit(EXIT_FAILURE);
     }
+
+    // recycle the oldest entry when full
+    int n = cached < (int)ARRAY_SIZE(cache) ? cached++ : 0;
+    FFTW(free)(cache[n].w);
+    cache[n].size = size;
+    cache[n].type = type;
+    cache[n].w = FFTW(alloc_real)(size);
+    for (int i = 0; i < size; i++) {
+        if (type == DHAN) {
+            cache[n].w[i] = M_PI / size * sin(2 * M_PI * i / size);
+        } else {
+            cache[n].w[i] = a0 - a1 * cos(2 * M_PI * i / size) + a2 * cos(4 * M_PI * i / size) - a3 * cos(6 * M_PI * i / size);
+        }
+    }
+    return cache[n].w;
+}
+
+// window size samples of the ring buffer in, whose oldest sample is at offset, into out
+void window(const sample_t *in, int offset, sample_t *out, int size, int type) {
     // detrending makes things worse
     // since there is no instrument drift
     // and the measurements are naturally centred at zero.
-    int n;
-    double w;
-    for (int i = 0; i < audio->FFTbufferSize; i++) {
-        // it's reindexed somewhere else, from the look of the waveform
-        //n = (audio->index + i) % audio->FFTbufferSize;
-        n = i;
-        w = a0 - a1 * cos(2 * M_PI * i / audio->FFTbufferSize) + a2 * cos(4 * M_PI * i / audio->FFTbufferSize) - a3 * cos(6 * M_PI * i / audio->FFTbufferSize);
-        audio->windowed_l[i] = w * audio->in_l[n];
-        audio->windowed_r[i] = w * audio->in_r[n];
+    // Two plain multiplies over the unwrapped ring, so the compiler vectorises them.
+    const sample_t *restrict w = window_table(size, type);
+    const sample_t *restrict older = in + offset;
+    sample_t *restrict windowed = out;
+    int i, split = size - offset;
+    for (i = 0; i < split; i++) {
+        windowed[i] = w[i] * older[i];
+    }
+    for (; i < size; i++) {
+        windowed[i] = w[i] * in[i - split];
     }
 }
 
 
-// bin together power spectrum in dB
-int *make_bins(struct audio_data *audio, int number_of_bins, int channel) {
-    int *bins;
-    register int n, i;
-    double power[number_of_bins];
-    fftw_complex *out;
-    static int bins_left[8192];
-    static int bins_right[8192];
-
-    if (channel == LEFT_CHANNEL) {
-        bins = bins_left;
-        out = audio->out_l;
-    } else {
-        bins = bins_right;
-        out = audio->out_r;
+// transform bins imin <= i < imax lie between the lower and upper cutoff frequencies
+void bin_range(int size, unsigned int rate, int *imin, int *imax) {
+    *imin = floor((double)LOWER_CUTOFF_FREQ * size / rate) + 1;
+    *imax = fmin(floor((double)UPPER_CUTOFF_FREQ * size / rate), (size / 2 + 1));
+}
+
+// 10 log10 of n powers, into out, which may be in.
+// One pass without calls or branches, so the compiler vectorises it.
+void power_dB(const sample_t *in, sample_t *out, int n) {
+    for (int i = 0; i < n; i++) {
+        float x = (float)in[i];
+        int32_t bits;
+        // the bit patterns of positive floats are in order, and zero and negatives are below them
+        memcpy(&bits, &x, sizeof(bits));
+        bits = bits > DB_MIN_POWER_BITS ? bits : DB_MIN_POWER_BITS;
+        memcpy(&x, &bits, sizeof(x));
+        // 10 log10(2)
+        out[i] = 3.0102999566398120f * fast_log2(x);
+    }
+}
+
+// scale of each transform bin's power: 1/f for a log f ordinate, times the weighting,
+// cached until the size, rate or weighting changes
+static const sample_t *bin_gain(int size, unsigned int rate, const struct weighting *w) {
+    static sample_t *gain = NULL;
+    static int g_size = 0;
+    static unsigned int g_rate = 0, g_generation = 0;
+    unsigned int generation = w ? w->generation : 0;
+    if (size != g_size || rate != g_rate || generation != g_generation) {
+        g_size = size;
+        g_rate = rate;
+        g_generation = generation;
+        free(gain);
+        gain = malloc(sizeof(sample_t) * (size / 2 + 1));
+        gain[0] = 0;
+        for (int i = 1; i < size / 2 + 1; i++) {
+            gain[i] = weighting_gain(w, (double)i * rate / size) / i;
+        }
     }
+    return gain;
+}
+
+// bin together the power spectrum of a size point transform into number_of_bins log-spaced bins,
+// weighted by w, which may be NULL
+void make_bins(const fft_complex *out, int size, unsigned int rate, const struct weighting *w, sample_t *bins, int number_of_bins) {
+    register int n, i;
+    sample_t power;
+    // bin edges, cached until the size or rate changes
+    static int *edge = NULL;
+    static int e_size = 0, e_bins = 0;
+    static unsigned int e_rate = 0;
 
     // get total signal power in each bin,
     // and space bins logarithmically.
-    // freq[i] = i * rate / FFTbufferSize;
-    // so log[i](i) = log(freq[i] * FFTbufferSize / rate);
+    // freq[i] = i * rate / size;
+    // so log[i](i) = log(freq[i] * size / rate);
     // and log[i] equally spaced over bins
-    int imin = floor(LOWER_CUTOFF_FREQ * audio->FFTbufferSize / audio->rate) + 1;
-    int imax = fmin(floor(UPPER_CUTOFF_FREQ * audio->FFTbufferSize / audio->rate), (audio->FFTbufferSize / 2 + 1));
+    int imin, imax;
+    bin_range(size, rate, &imin, &imax);
 
-    memset(power, 0, sizeof(double) * number_of_bins);
+    if (size != e_size || rate != e_rate || number_of_bins != e_bins) {
+        e_size = size;
+        e_rate = rate;
+        e_bins = number_of_bins;
+        free(edge);
+        edge = malloc(sizeof(int) * (number_of_bins + 1));
+        // log bin spacing, nearest bin; n is monotonic in i,
+        // so each bin is the contiguous range edge[n] <= i < edge[n + 1]
+        for (n = 0; n <= number_of_bins; n++) {
+            edge[n] = imax;
+        }
+        for (i = imax - 1; i >= imin; i--) {
+            n = (int)(number_of_bins * (log(i) - log(imin)) / (log(imax) - log(imin)));
+            edge[n] = i;
+        }
+        for (n = number_of_bins - 1; n >= 0; n--) {
+            edge[n] = min(edge[n], edge[n + 1]);
+        }
+    }
+    const sample_t *gain = bin_gain(size, rate, w);
 
-    for (i = imin; i < imax; i++) {
+    for (n = 0; n < number_of_bins; n++) {
         // signal power
-        // log bin spacing, nearest bin
-        n = (int)(number_of_bins * (log(i) - log(imin)) / (log(imax) - log(imin)));
-        // integrating over bins, multiply by 1/f (i here) for log f ordinate
+        // integrating over bins, multiply by 1/f (i here) for log f ordinate, and the weighting
+        power = 0;
+        for (i = edge[n]; i < edge[n + 1]; i++) {
+            power += (out[i][0] * out[i][0] + out[i][1] * out[i][1]) * gain[i];
+        }
+        bins[n] = (power * imax) / ((sample_t)size * rate);
+    }
+}
 
-        // hack for testing
-        //printf("i: %d, imin: %d, imax: %d, n: %d, N: %d\n", i, imin, imax, n, number_of_bins);
+// the display bin make_bins() sums each transform bin of a size point transform into,
+// or -1 for those outside them, cached until the size, rate or number of bins changes
+const int *bin_bars(int size, unsigned int rate, int number_of_bins) {
+    static int *bar = NULL;
+    static int b_size = 0, b_bins = 0;
+    static unsigned int b_rate = 0;
+    if (size != b_size || rate != b_rate || number_of_bins != b_bins) {
+        int imin, imax;
+        bin_range(size, rate, &imin, &imax);
+        b_size = size;
+        b_rate = rate;
+        b_bins = number_of_bins;
+        free(bar);
+        bar = malloc(sizeof(int) * (size / 2 + 1));
+        for (int i = 0; i < size / 2 + 1; i++) {
+            bar[i] = i < imin || i >= imax ? -1
+                : (int)(number_of_bins * (log(i) - log(imin)) / (log(imax) - log(imin)));
+        }
+    }
+    return bar;
+}
 
-        power[n] += (out[i][0] * out[i][0] + out[i][1] * out[i][1]) / i;
+// the level in dB of each transform bin imin <= i < imax, into levels, on the scale of
+// the display bins make_bins() sums them into, so a sinusoid alone in a bin reads the same
+void bin_levels(const fft_complex *out, int size, unsigned int rate, const struct weighting *w, sample_t *levels) {
+    int imin, imax;
+    bin_range(size, rate, &imin, &imax);
+    const sample_t *gain = bin_gain(size, rate, w);
+    for (int i = imin; i < imax; i++) {
+        levels[i] = (out[i][0] * out[i][0] + out[i][1] * out[i][1]) * gain[i] * imax / ((sample_t)size * rate);
     }
+    power_dB(levels + imin, levels + imin, imax - imin);
+}
 
+// As make_bins(), but each transform bin's power is moved to its reassigned frequency,
+// from the transforms of the Hann (out) and Hann derivative (out_d) windowed history.
+// A sinusoid's power all lands at its own frequency instead of across the main lobe.
+void make_bins_reassigned(const fft_complex *out, const fft_complex *out_d, int size, unsigned int rate,
+        const struct weighting *w, sample_t *bins, int number_of_bins) {
+    int n, i, imin, imax;
+    bin_range(size, rate, &imin, &imax);
+    // the weighting of the bin the power came from, and 1/f of where it went
+    const sample_t *gain = bin_gain(size, rate, w);
+    const float log_imin = fast_log2(imin);
+    const float per_log = number_of_bins / (fast_log2(imax) - log_imin);
+    // rad/sample to transform bins
+    const double to_bins = size / (2 * M_PI);
+
+    memset(bins, 0, number_of_bins * sizeof(sample_t));
+    for (i = imin; i < imax; i++) {
+        sample_t power = out[i][0] * out[i][0] + out[i][1] * out[i][1];
+        if (power == 0) {
+            continue;
+        }
+        // omega = omega_i - Im(X_d conj(X)) / |X|^2
+        double f = i - (out_d[i][1] * out[i][0] - out_d[i][0] * out[i][1]) / power * to_bins;
+        if (f < imin || f >= imax) {
+            continue;
+        }
+        n = min(number_of_bins - 1, (int)((fast_log2(f) - log_imin) * per_log));
+        // integrating over bins, 1/f for log f ordinate
+        bins[n] += power * gain[i] * i / f;
+    }
     for (n = 0; n < number_of_bins; n++) {
-        bins[n] = (int)((power[n] * imax) / (audio->FFTbufferSize * audio->rate));
+        bins[n] = (bins[n] * imax) / ((sample_t)size * rate);
+    }
+}
+
+// set the FFTW planner rigour by name; false if the name is unknown
+bool fft_set_planner(const char *planner) {
+    if (!strcmp(planner, "estimate")) {
+        planner_flags = FFTW_ESTIMATE;
+    } else if (!strcmp(planner, "measure")) {
+        planner_flags = FFTW_MEASURE;
+    } else if (!strcmp(planner, "patient")) {
+        planner_flags = FFTW_PATIENT;
+    } else if (!strcmp(planner, "exhaustive")) {
+        planner_flags = FFTW_EXHAUSTIVE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// split large transforms over this many threads (0 for one per core)
+void fft_set_threads(int threads) {
+#ifdef FFTW_THREADS
+    static bool initialised = false;
+    if (!initialised) {
+        initialised = FFTW(init_threads)();
+    }
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    planner_threads = initialised ? max(1, threads) : 1;
+#else
+    (void)threads;
+    planner_threads = 1;
+#endif
+}
+
+// plan a real to complex transform, using wisdom if we have it
+fft_plan fft_plan_r2c(int n, sample_t *in, fft_complex *out) {
+#ifdef FFTW_THREADS
+    // small transforms are quicker than the cost of waking threads
+    FFTW(plan_with_nthreads)(n >= LARGE_FFT_SIZE ? planner_threads : 1);
+#endif
+    fft_plan plan = FFTW(plan_dft_r2c_1d)(n, in, out, planner_flags | FFTW_WISDOM_ONLY);
+    if (plan == NULL) {
+        debug("no wisdom for %d point transform, planning\n", n);
+        plan = FFTW(plan_dft_r2c_1d)(n, in, out, planner_flags);
+        wisdom_dirty = true;
+    }
+    return plan;
+}
+
+// plan a forward complex transform, using wisdom if we have it
+fft_plan fft_plan_dft(int n, fft_complex *in, fft_complex *out) {
+#ifdef FFTW_THREADS
+    FFTW(plan_with_nthreads)(n >= LARGE_FFT_SIZE ? planner_threads : 1);
+#endif
+    fft_plan plan = FFTW(plan_dft_1d)(n, in, out, FFTW_FORWARD, planner_flags | FFTW_WISDOM_ONLY);
+    if (plan == NULL) {
+        debug("no wisdom for %d point complex transform, planning\n", n);
+        plan = FFTW(plan_dft_1d)(n, in, out, FFTW_FORWARD, planner_flags);
+        wisdom_dirty = true;
+    }
+    return plan;
+}
+
+// fingerprint of the cpu, so wisdom is not reused on different hardware
+static unsigned long long cpu_hash(void) {
+    const char *keys[] = {"model name", "flags", "Features", "CPU implementer", "CPU part", "Model"};
+    bool seen[ARRAY_SIZE(keys)] = {false};
+    char line[4096];
+    // djb2
+    unsigned long long hash = 5381;
+    FILE *fp = fopen("/proc/cpuinfo", "r");
+    if (fp == NULL) {
+        return hash;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        for (size_t k = 0; k < ARRAY_SIZE(keys); k++) {
+            if (!seen[k] && !strncmp(line, keys[k], strlen(keys[k]))) {
+                seen[k] = true;
+                for (char *c = line; *c; c++) {
+                    hash = hash * 33 + (unsigned char)*c;
+                }
+            }
+        }
+    }
+    fclose(fp);
+    return hash;
+}
+
+// $XDG_CACHE_HOME/bellini/wisdom-<machine>-<cpu>-<fftw version>, creating the directory
+static bool wisdom_path(char *path, size_t length) {
+    char dir[PATH_MAX];
+    char version[64];
+    struct utsname host;
+    char *cacheHome = getenv("XDG_CACHE_HOME");
+
+    int n;
+    if (cacheHome != NULL) {
+        n = snprintf(dir, sizeof(dir), "%s/%s", cacheHome, PACKAGE);
+    } else {
+        cacheHome = getenv("HOME");
+        if (cacheHome == NULL) {
+            return false;
+        }
+        snprintf(dir, sizeof(dir), "%s/%s", cacheHome, ".cache");
+        mkdir(dir, 0777);
+        n = snprintf(dir, sizeof(dir), "%s/%s/%s", cacheHome, ".cache", PACKAGE);
+    }
+    if (n < 0 || (size_t)n >= sizeof(dir)) {
+        return false;
     }
-    return bins;
+    mkdir(dir, 0777);
+
+    if (uname(&host)) {
+        snprintf(host.machine, sizeof(host.machine), "unknown");
+    }
+    // version string may contain build options, keep it filename safe
+    snprintf(version, sizeof(version), "%s", FFTW(version));
+    for (char *c = version; *c; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '.' && *c != '-') {
+            *c = '_';
+        }
+    }
+    // a truncated path could name another machine's wisdom
+    n = snprintf(path, length, "%s/wisdom-%s-%016llx-%s%s", dir, host.machine, cpu_hash(), version,
+            sizeof(sample_t) == sizeof(float) ? "-single" : "");
+    return n > 0 && (size_t)n < length;
+}
+
+// load cached wisdom, so planning is near-instant
+bool fft_wisdom_load(void) {
+    char path[PATH_MAX];
+    if (!wisdom_path(path, sizeof(path))) {
+        return false;
+    }
+    debug("loading wisdom from %s\n", path);
+    return FFTW(import_wisdom_from_filename)(path);
+}
+
+// save wisdom, if planning has added to it
+bool fft_wisdom_save(void) {
+    char path[PATH_MAX];
+    if (!wisdom_dirty) {
+        return true;
+    }
+    if (!wisdom_path(path, sizeof(path))) {
+        return false;
+    }
+    debug("saving wisdom to %s\n", path);
+    if (!FFTW(export_wisdom_to_filename)(path)) {
+        fprintf(stderr, "Could not save FFTW wisdom to %s\n", path);
+        return false;
+    }
+    wisdom_dirty = false;
+    return true;
+}
+
+
+// time window, transform and binning at a few FFT sizes, for comparing builds
+void bench_fft(void) {
+    const int sizes[] = {8192, 32768};
+    const int frames = 500;
+    const int number_of_bins = 400;
+    const unsigned int rate = 44100;
+    struct timespec t0, t1;
+    sample_t bins[number_of_bins];
+
+    // -b runs before the config sets the threads, and FFTW's threads must be set up
+    // before anything is planned
+    fft_set_threads(1);
+    printf("FFT frame time (%s precision, window + 2 transforms + binning)\n",
+            sizeof(sample_t) == sizeof(float) ? "single" : "double");
+    for (size_t s = 0; s < ARRAY_SIZE(sizes); s++) {
+        int size = sizes[s];
+        sample_t *in = FFTW(alloc_real)(size);
+        sample_t *windowed = FFTW(alloc_real)(size);
+        fft_complex *out = FFTW(alloc_complex)(size / 2 + 1);
+        fft_plan plan = fft_plan_r2c(size, windowed, out);
+        for (int i = 0; i < size; i++) {
+            in[i] = rand() % 65536 - 32768;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (int f = 0; f < frames; f++) {
+            // left and right channels
+            for (int channel = 0; channel < 2; channel++) {
+                window(in, f % size, windowed, size, HANN);
+                FFTW(execute)(plan);
+                make_bins(out, size, rate, NULL, bins, number_of_bins);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double ms = 1e3 * (t1.tv_sec - t0.tv_sec) + 1e-6 * (t1.tv_nsec - t0.tv_nsec);
+        printf("%8d points: %8.3f ms\n", size, ms / frames);
+        FFTW(destroy_plan)(plan);
+        FFTW(free)(in);
+        FFTW(free)(windowed);
+        FFTW(free)(out);
+    }
+
+#ifdef FFTW_THREADS
+    // large transforms against thread count, transform only
+    const int large_sizes[] = {LARGE_FFT_SIZE, 65536, 131072, MAX_FFT_SIZE};
+    const int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    printf("\nlarge transform time against threads (%d cores)\n", cores);
+    printf("  points");
+    for (int threads = 1; threads <= cores; threads *= 2) {
+        printf("  %2d thread%s", threads, threads > 1 ? "s" : " ");
+    }
+    printf("\n");
+    for (size_t s = 0; s < ARRAY_SIZE(large_sizes); s++) {
+        int size = large_sizes[s];
+        int repeats = max(10, 50 * LARGE_FFT_SIZE / size);
+        sample_t *windowed = FFTW(alloc_real)(size);
+        fft_complex *out = FFTW(alloc_complex)(size / 2 + 1);
+        printf("%8d", size);
+        for (int threads = 1; threads <= cores; threads *= 2) {
+            fft_set_threads(threads);
+            fft_plan plan = fft_plan_r2c(size, windowed, out);
+            for (int i = 0; i < size; i++) {
+                windowed[i] = rand() % 65536 - 32768;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            for (int r = 0; r < repeats; r++) {
+                FFTW(execute)(plan);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            double ms = 1e3 * (t1.tv_sec - t0.tv_sec) + 1e-6 * (t1.tv_nsec - t0.tv_nsec);
+            printf("  %7.2f ms", ms / repeats);
+            fflush(stdout);
+            FFTW(destroy_plan)(plan);
+        }
+        printf("\n");
+        FFTW(free)(windowed);
+        FFTW(free)(out);
+    }
+#endif
 }
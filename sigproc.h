@@ -6,15 +6,77 @@
 #define LOWER_CUTOFF_FREQ 20
 #define UPPER_CUTOFF_FREQ 20000
 
+#define DEFAULT_FFT_SIZE 8192
+
+// transforms at least this long are planned across threads and run less often
+#define LARGE_FFT_SIZE 32768
+#define MAX_FFT_SIZE 262144
+// at most this many large transforms per second
+#define LARGE_FFT_RATE 4
+
+#ifndef M_PI
+#define M_PI 3.1415926535897932385
+#endif
+
 #define RECT 0
 #define HANN 1
 #define BLAC 2
+// derivative of the Hann window, per sample, for frequency reassignment
+#define DHAN 3
+
+// power_dB() reads powers at or below 1e-30, whose float bit pattern this is, as DB_FLOOR
+#define DB_MIN_POWER_BITS 0x0da24260
+#define DB_FLOOR -300
+
+#include <stdbool.h>
 
 #include "input/common.h"
 
+struct weighting;
+
+// log2 of a positive normal float, to within 1.2e-5 (4e-5dB), with no transcendental calls.
+// x = 2^e m with m in [1/sqrt(2), sqrt(2)), and log m = 2 atanh((m - 1) / (m + 1)) by its series.
+static inline float fast_log2(float x) {
+    int32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int32_t e = (bits - 0x3f3504f3) >> 23;
+    bits -= e * (1 << 23);
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+    float s = (m - 1) / (m + 1);
+    float s2 = s * s;
+    // 2 / ln 2 (s + s^3 / 3 + s^5 / 5)
+    return e + 2.8853900817779268f * s * (1 + s2 * (0.33333333f + s2 * 0.2f));
+}
+
+
+const sample_t *window_table(int size, int type);
+
+void window(const sample_t *in, int offset, sample_t *out, int size, int type);
+
+void bin_range(int size, unsigned int rate, int *imin, int *imax);
+
+void power_dB(const sample_t *in, sample_t *out, int n);
+
+void make_bins(const fft_complex *out, int size, unsigned int rate, const struct weighting *w, sample_t *bins, int number_of_bins);
+
+const int *bin_bars(int size, unsigned int rate, int number_of_bins);
+
+void bin_levels(const fft_complex *out, int size, unsigned int rate, const struct weighting *w, sample_t *levels);
+
+void make_bins_reassigned(const fft_complex *out, const fft_complex *out_d, int size, unsigned int rate,
+        const struct weighting *w, sample_t *bins, int number_of_bins);
+
+bool fft_set_planner(const char *planner);
+
+void fft_set_threads(int threads);
+
+fft_plan fft_plan_r2c(int n, sample_t *in, fft_complex *out);
+
+fft_plan fft_plan_dft(int n, fft_complex *in, fft_complex *out);
+
+bool fft_wisdom_load(void);
 
-void window(struct audio_data *audio, int type);
+bool fft_wisdom_save(void);
 
-int *make_bins(struct audio_data *audio,
-        int number_of_bins,
-        int channel);
+void bench_fft(void);
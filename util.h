@@ -15,3 +15,12 @@
     })
 
 #define ARRAY_SIZE(x) ((sizeof(x) / sizeof(0 [x])) / ((size_t)(!(sizeof(x) % sizeof(0 [x])))))
+
+// Precision of the capture-to-bins analysis chain.
+// Configure with --enable-single-precision to run it in float (fftwf),
+// which doubles the SIMD width and halves the cache footprint on ARM.
+#ifdef SINGLE_PRECISION
+typedef float sample_t;
+#else
+typedef double sample_t;
+#endif